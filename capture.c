@@ -0,0 +1,207 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+#define _GNU_SOURCE /* for fallocate */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <linux/input.h>
+
+#include "footlog.h"
+
+/* Raw capture stream.  Every input event is appended, with the index
+   of the device it came from, to a large page-aligned buffer; the
+   buffer goes to disk in one write() when it fills up or when
+   logevents() is about to block with no sequence in progress.  So the
+   sequence path only ever pays for a 16-byte copy per event.
+
+   Disk space for a full day at the pedal's maximum event rate is
+   reserved up front with fallocate(FALLOC_FL_KEEP_SIZE), and again
+   for each further day, so that the file stays contiguous and a full
+   disk shows up at startup rather than in the middle of a session.
+   KEEP_SIZE leaves the visible file length equal to the data written,
+   so readers never see a tail of zeroes.  The unused part of the
+   reservation is given back by capture_close() at shutdown, and by
+   capture_trim() when a capture left by a session that did not shut
+   down cleanly is archived. */
+
+char CaptureFileName[BUFLEN] = ""; /* empty means no capture */
+
+#define CAPBUFLEN (1 << 18) /* bytes; 16384 records */
+
+static int capfd = -1;
+static struct caprec *capbuf;
+static int capcount;         /* records now in capbuf */
+static off_t capoffset;      /* bytes written to capfd so far */
+static off_t capreserved;    /* bytes reserved with fallocate() */
+static off_t capday;         /* bytes needed for one day */
+
+static void capture_reserve()
+/* Reserve another day's worth of disk space beyond capreserved */
+{
+  int rc;
+
+  rc = fallocate(capfd, FALLOC_FL_KEEP_SIZE, capreserved, capday);
+  if (rc < 0) {
+    /* not supported by this file system; just write as we go */
+    if (DebugFlag) perror("fallocate");
+    capday = 0;
+    return;
+  }
+  capreserved += capday;
+  if (DebugFlag) fprintf(stderr, "Capture space reserved: %lld bytes\n",
+			 (long long) capreserved);
+}
+
+static void release_tail(int fd, off_t from, off_t len, const char *name)
+/* Free the blocks of fd in [from, from+len), where from is the end
+   of its data.  Truncating to the same length drops the blocks past
+   it on ext4; some file systems keep them, but will punch them out */
+{
+  if (len <= 0) return;
+  if (ftruncate(fd, from) < 0) perror(name);
+  fallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, from, len); /* best effort */
+}
+
+void capture_trim(const char *name)
+/* Give back any space still reserved beyond the data of the capture
+   file name */
+{
+  struct stat sb;
+  int fd;
+
+  fd = open(name, O_WRONLY);
+  if (fd < 0) {
+    if (errno != ENOENT) perror(name);
+    return;
+  }
+  /* Whatever is allocated, at most, lies past the end */
+  if (!fstat(fd, &sb)) release_tail(fd, sb.st_size, (off_t) sb.st_blocks * 512, name);
+  close(fd);
+}
+
+int capture_first(const char *name, time_t *sec, int *msec)
+/* Time of the first record in the capture file name, in *sec and
+   *msec.  Returns 0, or -1 if there is no such file or no record */
+{
+  struct capheader hdr;
+  struct caprec rec;
+  int fd, ok;
+
+  fd = open(name, O_RDONLY);
+  if (fd < 0) return(-1);
+  ok = read(fd, &hdr, sizeof(hdr)) == sizeof(hdr)
+    && !memcmp(hdr.magic, CAPMAGIC, sizeof(hdr.magic))
+    && hdr.recsize == sizeof(rec)
+    && read(fd, &rec, sizeof(rec)) == sizeof(rec);
+  close(fd);
+  if (!ok) return(-1);
+
+  *sec = rec.sec;
+  *msec = CAPUSEC(&rec) / 1000;
+  return(0);
+}
+
+void capture_open(int evrate, int ndev)
+/* Create CaptureFileName and write its header.  evrate is the maximum
+   number of events per second expected from all devices together */
+{
+  struct capheader hdr;
+  int rc;
+
+  capfd = open(CaptureFileName, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (capfd < 0) {
+    perror(CaptureFileName);
+    exit(-1);
+  }
+
+  rc = posix_memalign((void **) &capbuf, 4096, CAPBUFLEN);
+  if (rc) {
+    fprintf(stderr, "Can't allocate capture buffer: %s\n", strerror(rc));
+    exit(-1);
+  }
+
+  capday = (off_t) evrate * 86400 * sizeof(struct caprec);
+  capreserved = 0;
+  capcount = 0;
+  capture_reserve();
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, CAPMAGIC, sizeof(hdr.magic));
+  hdr.recsize = sizeof(struct caprec);
+  hdr.ndev = ndev;
+  if (write(capfd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+    perror(CaptureFileName);
+    exit(-1);
+  }
+  capoffset = sizeof(hdr);
+}
+
+void capture_flush()
+/* Write out whatever is in the capture buffer */
+{
+  ssize_t len, rc;
+  char *p;
+
+  if (capfd < 0 || !capcount) return;
+
+  len = capcount * sizeof(struct caprec);
+  if (capday && capoffset + len > capreserved) capture_reserve();
+
+  p = (char *) capbuf;
+  while (len > 0) {
+    rc = write(capfd, p, len);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      perror(CaptureFileName);
+      exit(-1);
+    }
+    p += rc;
+    len -= rc;
+    capoffset += rc;
+  }
+  capcount = 0;
+}
+
+void capture_close()
+/* Write out the buffer and give back the unused reservation */
+{
+  if (capfd < 0) return;
+
+  capture_flush();
+  release_tail(capfd, capoffset, capreserved - capoffset, CaptureFileName);
+  if (close(capfd) < 0) perror(CaptureFileName);
+  capfd = -1;
+}
+
+void capture_event(int dev, struct input_event *e)
+/* Append one event from device number dev to the capture buffer */
+{
+  struct caprec *r;
+
+  if (capfd < 0) return;
+
+  r = &capbuf[capcount];
+  r->sec = e->time.tv_sec;
+  r->usec_dev = ((uint32_t) dev << CAPDEVSHIFT) | (uint32_t) e->time.tv_usec;
+  r->type = e->type;
+  r->code = e->code;
+  r->value = e->value;
+
+  if (++capcount == CAPBUFLEN/sizeof(struct caprec)) capture_flush();
+}
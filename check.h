@@ -0,0 +1,42 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* What the unit tests (*_test.c) share: CHECK() reports and counts a
+   failed condition without stopping the test, and check_result()
+   gives main() its summary line and exit status. */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do {						\
+    if (!(cond)) {							\
+      fprintf(stderr, "%s:%d: %s: check failed: %s\n",			\
+	      __FILE__, __LINE__, __func__, #cond);			\
+      failures++;							\
+    }									\
+  } while (0)
+
+static inline int check_result(const char *name, const char *note)
+/* Report the failures, or that all the tests of program name passed,
+   followed by note in parentheses unless it is null.  Returns the
+   exit status for main() */
+{
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return(1);
+  }
+  if (note) printf("%s: all tests passed (%s)\n", name, note);
+  else printf("%s: all tests passed\n", name);
+  return(0);
+}
+
+#endif /* CHECK_H */
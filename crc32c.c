@@ -0,0 +1,120 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "crc32c.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define HAVE_CRC32_INSN 1
+#endif
+
+#define POLY 0x82f63b78 /* CRC32C, reflected */
+
+/* Software fallback: slicing by 8, eight table lookups per 8 bytes */
+static uint32_t table[8][256];
+static int table_ready = 0;
+
+static void make_table()
+{
+  uint32_t c;
+  int i, k;
+
+  for (i = 0; i < 256; i++) {
+    c = i;
+    for (k = 0; k < 8; k++) c = c & 1 ? (c >> 1) ^ POLY : c >> 1;
+    table[0][i] = c;
+  }
+  for (i = 0; i < 256; i++) {
+    c = table[0][i];
+    for (k = 1; k < 8; k++) {
+      c = table[0][c & 0xff] ^ (c >> 8);
+      table[k][i] = c;
+    }
+  }
+  table_ready = 1;
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len)
+/* CRC32C without special instructions */
+{
+  const unsigned char *p = buf;
+  uint64_t w;
+
+  if (!table_ready) make_table();
+  crc = ~crc;
+  while (len && ((uintptr_t) p & 7)) {
+    crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    len--;
+  }
+  while (len >= 8) {
+    memcpy(&w, p, 8); /* little-endian, like the instruction */
+    w ^= crc;
+    crc = table[7][w & 0xff] ^ table[6][(w >> 8) & 0xff]
+      ^ table[5][(w >> 16) & 0xff] ^ table[4][(w >> 24) & 0xff]
+      ^ table[3][(w >> 32) & 0xff] ^ table[2][(w >> 40) & 0xff]
+      ^ table[1][(w >> 48) & 0xff] ^ table[0][w >> 56];
+    p += 8;
+    len -= 8;
+  }
+  while (len--) crc = table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return(~crc);
+}
+
+#ifdef HAVE_CRC32_INSN
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len)
+/* CRC32C with the SSE4.2 crc32 instruction, 8 bytes at a time */
+{
+  const unsigned char *p = buf;
+  uint64_t c = ~crc, w;
+
+  while (len && ((uintptr_t) p & 7)) {
+    c = _mm_crc32_u8(c, *p++);
+    len--;
+  }
+  while (len >= 8) {
+    memcpy(&w, p, 8);
+    c = _mm_crc32_u64(c, w);
+    p += 8;
+    len -= 8;
+  }
+  while (len--) c = _mm_crc32_u8(c, *p++);
+  return(~(uint32_t) c);
+}
+#endif
+
+int crc32c_hw_available()
+/* Does crc32c() use the instruction on this CPU? */
+{
+#ifdef HAVE_CRC32_INSN
+  return(__builtin_cpu_supports("sse4.2"));
+#else
+  return(0);
+#endif
+}
+
+static uint32_t (*impl)(uint32_t, const void *, size_t) = 0;
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+/* CRC32C, by whichever method this CPU supports; chosen on first use */
+{
+  if (!impl) {
+#ifdef HAVE_CRC32_INSN
+    impl = crc32c_hw_available() ? crc32c_hw : crc32c_sw;
+#else
+    impl = crc32c_sw;
+#endif
+  }
+  return(impl(crc, buf, len));
+}
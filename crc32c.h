@@ -0,0 +1,29 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* CRC32C (Castagnoli), as used to protect each log record.  Uses the
+   SSE4.2 crc32 instruction when the CPU has it, and a table otherwise;
+   both give the same result.  Start with crc = 0; to continue over
+   more data, pass the previous result. */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Every record in a log ends with this and 8 hex digits: the CRC32C
+   of the text of the line before it */
+#define CRCTAG "  crc="
+#define CRCTAGLEN 6
+
+extern uint32_t crc32c(uint32_t, const void *, size_t);
+extern uint32_t crc32c_sw(uint32_t, const void *, size_t);
+extern int crc32c_hw_available();
+
+#endif /* CRC32C_H */
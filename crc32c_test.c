@@ -0,0 +1,68 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Tests for crc32c.c.  Run by "make test".  Known values from RFC 3720,
+   and the instruction against the table on random buffers of every
+   alignment and length. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32c.h"
+#include "check.h"
+
+static void test_known_values()
+{
+  unsigned char buf[32];
+  int i;
+
+  CHECK(crc32c(0, "", 0) == 0);
+  CHECK(crc32c(0, "123456789", 9) == 0xe3069283);
+  CHECK(crc32c_sw(0, "123456789", 9) == 0xe3069283);
+
+  memset(buf, 0, sizeof(buf));
+  CHECK(crc32c(0, buf, 32) == 0x8a9136aa);
+  memset(buf, 0xff, sizeof(buf));
+  CHECK(crc32c(0, buf, 32) == 0x62a8ab43);
+  for (i = 0; i < 32; i++) buf[i] = i;
+  CHECK(crc32c(0, buf, 32) == 0x46dd794e);
+}
+
+static void test_hw_matches_sw()
+{
+  unsigned char buf[4096 + 8];
+  int i, off, len;
+
+  srandom(7);
+  for (i = 0; i < (int) sizeof(buf); i++) buf[i] = random();
+  for (off = 0; off < 8; off++) {
+    for (len = 0; len < 300; len++)
+      CHECK(crc32c(0, buf + off, len) == crc32c_sw(0, buf + off, len));
+    CHECK(crc32c(0, buf + off, 4096) == crc32c_sw(0, buf + off, 4096));
+  }
+}
+
+static void test_continuation()
+/* CRC of a whole equals CRC continued over its parts */
+{
+  const char *s = "1637000000.123: UP  seqlen = 990 ms  key1count = 31  gap = 1000 ms";
+  int len = strlen(s), k;
+
+  for (k = 0; k <= len; k++)
+    CHECK(crc32c(crc32c(0, s, k), s + k, len - k) == crc32c(0, s, len));
+}
+
+int main()
+{
+  test_known_values();
+  test_hw_matches_sw();
+  test_continuation();
+
+  return(check_result("crc32c_test", crc32c_hw_available() ? "sse4.2" : "table only"));
+}
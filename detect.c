@@ -0,0 +1,392 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "detect.h"
+
+
+void detect_init(detector_t *d, const detparams_t *p,
+		 detsink_t sink, void *sinkarg, detclock_t clock, void *clockarg)
+/* Initialize detector d with parameters p.  Records are passed to
+   sink; clock is consulted by detect_poll() and may be null if that
+   is never called */
+{
+  memset(d, 0, sizeof(*d));
+  d->p = *p;
+  d->ibucket = -1;
+  d->sink = sink;
+  d->sinkarg = sinkarg;
+  d->clock = clock;
+  d->clockarg = clockarg;
+}
+
+
+void detect_settrace(detector_t *d, dettrace_t trace, void *arg)
+/* Pass the detector's decisions to trace as well; null for none */
+{
+  d->trace = trace;
+  d->tracearg = arg;
+}
+
+static void Trace(detector_t *d, int what, mstime_t now, mstime_t value)
+{
+  if (d->trace) d->trace(d->tracearg, what, now, value);
+}
+
+
+static void StartSequence(detector_t *d, mstime_t now)
+   /* Using now as current time, initialize the current sequence */
+{
+  seq_t *cs = &d->seq;
+
+  Trace(d, DETTRACE_START, now, 0);
+  cs->active = 1;
+  cs->FirstOne = now;
+  cs->LastOne = now;
+
+  /*We shouldn't yet log the start of this sequence because it may
+    prove to be a runt; DOWN waits until SequenceExtended() or
+    EndSequence() shows that it is not */
+}
+
+
+static void AbsSample(seq_t *cs, mstime_t now, int value)
+/* Fold one EV_ABS sample into the running aggregates of the sequence
+   pointed to by cs */
+{
+  mstime_t dt;
+
+  if (!cs->abscount) {
+    cs->absmin = value;
+    cs->absmax = value;
+  }
+  else {
+    dt = now - cs->AbsLast;
+    if (dt > 0) {
+      cs->absintegral += (double) cs->abslast * dt;
+      cs->absspan += dt;
+    }
+    if (value < cs->absmin) cs->absmin = value;
+    if (value > cs->absmax) cs->absmax = value;
+  }
+  cs->abscount++;
+  cs->abssum += value;
+  cs->abslast = value;
+  cs->AbsLast = now;
+}
+
+
+static void IntensityFlush(detector_t *d)
+/* Emit the interval being accumulated, if any */
+{
+  detrec_t rec;
+
+  if (d->ibucket < 0) return;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.kind = REC_INTENSITY;
+  rec.time = d->ibucket * d->p.intensitymilli;
+  rec.value = d->ipeak;
+  d->sink(d->sinkarg, &rec);
+  d->ibucket = -1;
+}
+
+static void IntensitySample(detector_t *d, mstime_t now, int value)
+/* Decimate analog samples: at most one REC_INTENSITY per
+   intensitymilli milliseconds, however fast the pedal reports.
+   Intervals without samples are not emitted; readers should hold the
+   previous value. */
+{
+  int64_t bucket;
+
+  if (d->p.intensitymilli <= 0) return;
+
+  bucket = now / d->p.intensitymilli;
+  if (bucket != d->ibucket) {
+    IntensityFlush(d);
+    d->ibucket = bucket;
+    d->ipeak = value;
+  }
+  else if (value > d->ipeak) d->ipeak = value;
+}
+
+
+static void MarkerEmit(detector_t *d, mstime_t t, const char *text, int len)
+{
+  detrec_t rec;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.kind = REC_MARKER;
+  rec.time = t;
+  rec.text = text;
+  rec.len = len;
+  d->sink(d->sinkarg, &rec);
+}
+
+static void MarkerRelease(detector_t *d, mstime_t upto)
+/* Emit held-back markers stamped earlier than upto, oldest first */
+{
+  marker_t *m;
+
+  while (d->markhead < d->nmark) {
+    m = &d->markq[d->markhead];
+    if (m->time >= upto) break;
+    MarkerEmit(d, m->time, m->text, m->len);
+    d->markhead++;
+  }
+  if (d->markhead == d->nmark) d->markhead = d->nmark = 0;
+}
+
+static void DownEmit(detector_t *d)
+/* Emit REC_DOWN for the current sequence, preceded by any markers
+   that happened before it */
+{
+  seq_t *cs = &d->seq;
+  detrec_t rec;
+
+  MarkerRelease(d, cs->FirstOne);
+
+  memset(&rec, 0, sizeof(rec));
+  rec.kind = REC_DOWN;
+  rec.time = cs->FirstOne;
+  rec.seq = cs;
+  d->sink(d->sinkarg, &rec);
+  cs->downsent = 1;
+}
+
+static void SequenceExtended(detector_t *d)
+/* LastOne has moved on.  Once the sequence is longer than a runt its
+   start can be emitted, and so can the markers up to LastOne */
+{
+  seq_t *cs = &d->seq;
+
+  if (!cs->downsent && cs->LastOne - cs->FirstOne > d->p.runtmax) DownEmit(d);
+  if (cs->downsent && d->nmark) MarkerRelease(d, cs->LastOne + 1);
+}
+
+
+static void EndSequence(detector_t *d, int gapsize)
+/* gapsize is input parameter, expressed in milliseconds */
+{
+  seq_t *cs = &d->seq;
+  detrec_t rec;
+
+  /* Sequence ended at LastOne, which was at least gapsize
+     milliseconds ago.  Emit the end of it (and the start, if not
+     already done), unless it is a runt.  Held-back markers go in
+     between according to their times */
+  memset(&rec, 0, sizeof(rec));
+  rec.seqlen = cs->LastOne - cs->FirstOne;
+  rec.gap = gapsize;
+  rec.seq = cs;
+
+  if (rec.seqlen > d->p.runtmax) {
+    if (!cs->downsent) DownEmit(d);
+    MarkerRelease(d, cs->LastOne + 1);
+    rec.kind = REC_UP;
+    rec.time = cs->LastOne;
+    d->sink(d->sinkarg, &rec);
+  }
+  else {
+    rec.kind = REC_RUNT;
+    rec.time = cs->LastOne;
+    d->sink(d->sinkarg, &rec);
+  }
+  MarkerRelease(d, INT64_MAX);
+
+  /* Intensity is flushed at the same points as the sequences, so
+     that the sink can flush both together */
+  IntensityFlush(d);
+
+  /* Initialize to detect the next sequence.  All values in cs remain
+     zero until first new KEY_1 event. That's when a a new sequence starts */
+  memset(cs, 0, sizeof(*cs));
+}
+
+
+void detect_event(detector_t *d, mstime_t now, int type, int code, int value)
+/* Advance the detector by one input event that happened at time now */
+{
+  seq_t *cs = &d->seq;
+  mstime_t gap = 0;
+
+  if (cs->active) {
+    /* An event from another device node, or after the clock was
+       stepped back, may be stamped earlier than LastOne.  It belongs
+       to the current sequence; it must not look like a huge gap */
+    gap = now - cs->LastOne;
+    if (gap < 0) gap = 0;
+
+    /* End current sequence; emit it; reset counters */
+    if (d->p.mode == DETECT_KEY && gap >= d->p.gapsize) {
+      Trace(d, DETTRACE_GAPEND, now, gap);
+      EndSequence(d, gap);
+    }
+  }
+
+  /* Tolerate slight skew here; We are counting this event even
+     though new sequence has not yet begun. */
+  if (type >= 0 && type < EV_CNT) cs->evcount[type]++;
+
+  switch (type) {
+  case EV_KEY:
+    if (d->p.mode != DETECT_KEY || code != KEY_1) break;
+    if (!cs->active) {/* Begin new sequence */
+      StartSequence(d, now);
+      /* An autorepeat as the very first KEY_1 means the pedal was
+	 already down before we started listening */
+      if (!d->seen && value == 2) cs->heldstart = 1;
+    }
+    else {
+      Trace(d, DETTRACE_GAP, now, gap);
+      if (now > cs->LastOne) {/* continue current sequence */
+	cs->LastOne = now;
+	SequenceExtended(d);
+      }
+    }
+    cs->key1count++;
+    d->seen = 1;
+    break;
+
+  case EV_ABS:
+    if (d->p.absaxis >= 0 && code != d->p.absaxis) break;
+    IntensitySample(d, now, value);
+
+    if (d->p.mode != DETECT_ABS) {
+      /* digital detection; just record pressure while down */
+      if (cs->active) AbsSample(cs, now, value);
+      break;
+    }
+
+    /* Hysteresis: press at abshigh, release at abslow, so that
+       noise around a single threshold cannot split a press */
+    if (!cs->active) {
+      if (value >= d->p.abshigh) {
+	StartSequence(d, now);
+	AbsSample(cs, now, value);
+      }
+    }
+    else {
+      AbsSample(cs, now, value);
+      if (value <= d->p.abslow) {
+	if (now > cs->LastOne) cs->LastOne = now;
+	EndSequence(d, gap);
+      }
+      else if (now > cs->LastOne) {
+	cs->LastOne = now;
+	SequenceExtended(d);
+      }
+    }
+    d->seen = 1;
+    break;
+
+  default:
+    break;
+  }
+}
+
+
+mstime_t detect_deadline(const detector_t *d)
+/* Time at which the current sequence ends unless another KEY_1
+   arrives first; -1 if no timeout is pending.  An analog pedal ends
+   its sequence on release, not on a gap, so it never has one. */
+{
+  if (!d->seq.active || d->p.mode != DETECT_KEY) return(-1);
+  return(d->seq.LastOne + d->p.gapsize);
+}
+
+
+mstime_t detect_downthrough(const detector_t *d)
+/* Time up to which the pedal is known to have been down in the
+   current sequence, once REC_DOWN has been emitted for it; -1
+   otherwise.  This is LastOne, not the current time: a digital pedal
+   may already have been released, which only the gap will tell */
+{
+  if (!d->seq.downsent) return(-1);
+  return(d->seq.LastOne);
+}
+
+
+int detect_poll(detector_t *d)
+/* Check the clock against the deadline and end the current sequence
+   if it has passed.  Returns 1 if a sequence was ended, 0 otherwise */
+{
+  mstime_t deadline;
+
+  deadline = detect_deadline(d);
+  if (deadline < 0) return(0);
+  if (d->clock(d->clockarg) < deadline) return(0);
+
+  EndSequence(d, d->p.gapsize);
+  return(1);
+}
+
+
+void detect_finish(detector_t *d)
+/* End of input: end any open sequence as if its timeout had expired */
+{
+  if (d->seq.active) EndSequence(d, d->p.gapsize);
+  IntensityFlush(d);
+}
+
+
+void detect_marker(detector_t *d, mstime_t now, const char *text, int len)
+/* Add a marker with the given text at time now.  It is passed to the
+   sink at once if no sequence is in progress; otherwise it is held
+   back until its place relative to REC_DOWN and REC_UP is known */
+{
+  marker_t *m;
+
+  if (len > MARKLEN) len = MARKLEN;
+  if (len < 0) len = 0;
+
+  if (!d->seq.active && !d->nmark) {
+    MarkerEmit(d, now, text, len);
+    return;
+  }
+
+  if (d->nmark == d->markcap) {
+    if (d->markhead) {/* reclaim space of markers already emitted */
+      memmove(d->markq, d->markq + d->markhead,
+	      (d->nmark - d->markhead) * sizeof(marker_t));
+      d->nmark -= d->markhead;
+      d->markhead = 0;
+    }
+    else {
+      m = realloc(d->markq, (d->markcap ? 2*d->markcap : 64) * sizeof(marker_t));
+      if (!m) {/* out of memory; better out of place than lost */
+	MarkerEmit(d, now, text, len);
+	return;
+      }
+      d->markq = m;
+      d->markcap = d->markcap ? 2*d->markcap : 64;
+    }
+  }
+
+  m = &d->markq[d->nmark++];
+  m->time = now;
+  m->len = len;
+  memcpy(m->text, text, len);
+
+  if (d->seq.downsent) MarkerRelease(d, d->seq.LastOne + 1);
+}
+
+
+void detect_free(detector_t *d)
+/* Release memory held by d; it must be initialized again before use */
+{
+  free(d->markq);
+  d->markq = 0;
+  d->markhead = d->nmark = d->markcap = 0;
+}
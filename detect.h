@@ -0,0 +1,159 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Sequence detector.  Turns a stream of (timestamp, type, code, value)
+   tuples into DOWN/UP records.  It has no global state and performs
+   no I/O: time comes from the tuples and from an injected clock, and
+   records go to an injected sink.  So the same code serves the live
+   loop, offline replay, and the unit tests and benchmarks. */
+
+#ifndef DETECT_H
+#define DETECT_H
+
+#include <stdint.h>
+#include <linux/input.h>
+
+/* Detection modes: DETECT_KEY treats a stream of KEY_1 events
+   separated by less than the gap size as one press (digital pedal);
+   DETECT_ABS uses hysteresis on an EV_ABS axis (analog/pressure
+   pedal) */
+#define DETECT_KEY 0
+#define DETECT_ABS 1
+
+/* All times are in milliseconds since the epoch */
+typedef int64_t mstime_t;
+
+typedef struct detparams {
+  int gapsize;   /* milliseconds without KEY_1 that end a sequence */
+  int runtmax;   /* sequences no longer than this are runts */
+  int mode;      /* DETECT_KEY or DETECT_ABS */
+  int absaxis;   /* ABS_* code to watch; -1 for any */
+  int abshigh;   /* DETECT_ABS: press at or above this value */
+  int abslow;    /* DETECT_ABS: release at or below this value */
+  int intensitymilli; /* decimation interval for REC_INTENSITY; 0 for none */
+} detparams_t;
+
+/* The following structure keeps together all the parts relating to a
+   sequence of events that will be reported in an "UP" log entry at
+   the end of the sequence */
+typedef struct sequence {
+  /* FirstOne marks the first of a (possibly long) sequence of KEY_1
+   events.  LastOne marks the most recent KEY_1 event.  The sequence
+   is ended by a gap of at least gapsize milliseconds before the next
+   KEY_1 event. All other events are ignored for purposes of
+   timing/logging.  */
+  int active;
+  mstime_t FirstOne;
+  mstime_t LastOne;
+  int heldstart; /* pedal was already down when detection started */
+  int downsent;  /* REC_DOWN already emitted; sequence is not a runt */
+
+  /* Cumulative event stats within current sequence. Reset to zero at
+     start of current sequence.  We keep track of KEY_1 events
+     separately in key1count.  All other EV_KEY events are lumped
+     together in evcount[]
+ */
+  int key1count; /* how many KEY_1 events */
+  int evcount[EV_CNT]; /* how many of each type of event */
+
+  /* Running aggregates of EV_ABS samples within current sequence, for
+     analog pedals.  Each sample updates them in constant time, so
+     cost does not grow with sample rate.  The integral is in units of
+     value x milliseconds; evdev only reports changes, so the axis is
+     taken to hold its previous value until the next sample. */
+  int abscount;  /* how many EV_ABS samples */
+  int absmin;
+  int absmax;
+  long long abssum;
+  double absintegral;
+  int absspan; /* milliseconds covered by absintegral */
+  mstime_t AbsLast;
+  int abslast; /* value of most recent sample */
+} seq_t;
+
+/* Records delivered to the sink */
+#define REC_DOWN 1       /* start of a logged sequence */
+#define REC_UP 2         /* end of a logged sequence */
+#define REC_RUNT 3       /* sequence discarded as a runt */
+#define REC_INTENSITY 4  /* peak analog value over one interval */
+#define REC_MARKER 5     /* text supplied by detect_marker() */
+
+/* Markers from outside (e.g. stimulus software) share the timeline
+   with the sequences.  While a sequence is in progress they are held
+   back, so that the sink sees every record in time order even though
+   REC_DOWN is only emitted once the sequence is known not to be a
+   runt */
+#define MARKLEN 120 /* longer marker text is truncated */
+
+typedef struct marker {
+  mstime_t time;
+  int len;
+  char text[MARKLEN];
+} marker_t;
+
+typedef struct detrec {
+  int kind;      /* REC_* */
+  mstime_t time; /* FirstOne for REC_DOWN, LastOne for REC_UP and
+		    REC_RUNT, interval start for REC_INTENSITY */
+  int seqlen;    /* milliseconds, REC_UP and REC_RUNT */
+  int gap;       /* milliseconds that ended the sequence, REC_UP */
+  int value;     /* REC_INTENSITY */
+  const seq_t *seq; /* REC_DOWN, REC_UP and REC_RUNT; like text,
+		       valid only during the call to the sink */
+  const char *text; /* REC_MARKER, not null-terminated */
+  int len;          /* REC_MARKER */
+} detrec_t;
+
+typedef void (*detsink_t)(void *arg, const detrec_t *rec);
+typedef mstime_t (*detclock_t)(void *arg);
+
+/* Optional trace hook (see detect_settrace()), told of the decisions
+   that records do not show, as they are made: what, at the time of
+   the event that caused it, and a value */
+#define DETTRACE_START 1   /* a sequence started; value 0 */
+#define DETTRACE_GAP 2     /* KEY_1 continued the sequence; value is
+			      the gap since LastOne in ms */
+#define DETTRACE_GAPEND 3  /* the gap before this event, value ms,
+			      ended the sequence */
+typedef void (*dettrace_t)(void *arg, int what, mstime_t time, mstime_t value);
+
+typedef struct detector {
+  detparams_t p;
+  seq_t seq;
+  int seen;  /* a KEY_1 or watched axis event has been seen */
+
+  /* Decimated intensity: interval being accumulated, in units of
+     intensitymilli (-1 if none), and its peak so far */
+  int64_t ibucket;
+  int ipeak;
+
+  /* Markers held back: a FIFO in markq[markhead..nmark-1], grown as
+     needed; freed by detect_free() */
+  marker_t *markq;
+  int markhead, nmark, markcap;
+
+  detsink_t sink;
+  void *sinkarg;
+  detclock_t clock;
+  void *clockarg;
+  dettrace_t trace;  /* null unless set by detect_settrace() */
+  void *tracearg;
+} detector_t;
+
+extern void detect_init(detector_t *, const detparams_t *,
+			detsink_t, void *, detclock_t, void *);
+extern void detect_event(detector_t *, mstime_t, int, int, int);
+extern mstime_t detect_deadline(const detector_t *);
+extern mstime_t detect_downthrough(const detector_t *);
+extern int detect_poll(detector_t *);
+extern void detect_finish(detector_t *);
+extern void detect_marker(detector_t *, mstime_t, const char *, int);
+extern void detect_free(detector_t *);
+extern void detect_settrace(detector_t *, dettrace_t, void *);
+
+#endif /* DETECT_H */
@@ -0,0 +1,160 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Microbenchmark for the sequence detector in detect.c.  Run by
+   "make bench".  Synthetic streams are generated in memory first, so
+   only detect_event() and detect_poll() are timed.  Reports events
+   per second and, on x86, TSC cycles per event. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#include "detect.h"
+
+#define NEVENTS (8 << 20)
+#define ROUNDS 5
+
+typedef struct benchev {
+  mstime_t time;
+  int type, code, value;
+} benchev_t;
+
+static long nrecords;
+
+static void count_sink(void *arg, const detrec_t *rec)
+{
+  (void) arg;
+  (void) rec;
+  nrecords++;
+}
+
+static mstime_t bench_clock(void *arg)
+{
+  return(*(mstime_t *) arg);
+}
+
+static long gen_key(benchev_t *ev, long max)
+/* Digital pedal: presses of random length with 33 ms autorepeat,
+   each report being EV_MSC, EV_KEY, EV_SYN */
+{
+  mstime_t t = 1637000000000LL, end;
+  long n = 0;
+  int first;
+
+  while (n + 3 <= max) {
+    end = t + 50 + random() % 4000;
+    for (first = 1; t <= end && n + 3 <= max; t += 33, first = 0) {
+      ev[n++] = (benchev_t) {t, EV_MSC, MSC_SCAN, 0x7001e};
+      ev[n++] = (benchev_t) {t, EV_KEY, KEY_1, first ? 1 : 2};
+      ev[n++] = (benchev_t) {t, EV_SYN, SYN_REPORT, 0};
+    }
+    t += 1000 + random() % 10000;
+  }
+  return(n);
+}
+
+static long gen_abs(benchev_t *ev, long max)
+/* Analog pedal at 1 kHz: pressure ramps up and down, EV_ABS + EV_SYN */
+{
+  mstime_t t = 1637000000000LL;
+  long n = 0;
+  int v;
+
+  while (n + 2 <= max) {
+    v = (t / 3) % 1024;
+    if (v > 511) v = 1023 - v;
+    ev[n++] = (benchev_t) {t, EV_ABS, ABS_Z, v + random() % 8};
+    ev[n++] = (benchev_t) {t, EV_SYN, SYN_REPORT, 0};
+    t++;
+  }
+  return(n);
+}
+
+static void run(const char *name, benchev_t *ev, long n, detparams_t *p)
+{
+  detector_t d;
+  struct timespec t0, t1;
+  double secs, best = 1e9;
+  mstime_t now;
+  long i;
+  int r;
+#ifdef HAVE_RDTSC
+  unsigned long long c0, c1, bestcycles = ~0ULL;
+#endif
+
+  for (r = 0; r < ROUNDS; r++) {
+    nrecords = 0;
+    detect_init(&d, p, count_sink, 0, bench_clock, &now);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+#ifdef HAVE_RDTSC
+    c0 = __rdtsc();
+#endif
+    for (i = 0; i < n; i++) {
+      now = ev[i].time;
+      detect_poll(&d);
+      detect_event(&d, ev[i].time, ev[i].type, ev[i].code, ev[i].value);
+    }
+    detect_finish(&d);
+    detect_free(&d);
+#ifdef HAVE_RDTSC
+    c1 = __rdtsc();
+    if (c1 - c0 < bestcycles) bestcycles = c1 - c0;
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    if (secs < best) best = secs;
+  }
+
+  printf("%-12s %9ld events %7ld records  %8.1f Mevents/s  %6.2f ns/event",
+	 name, n, nrecords, n / best / 1e6, best * 1e9 / n);
+#ifdef HAVE_RDTSC
+  printf("  %6.2f cycles/event", (double) bestcycles / n);
+#endif
+  printf("\n");
+}
+
+int main()
+{
+  benchev_t *ev;
+  detparams_t p;
+  long n;
+
+  ev = malloc(NEVENTS * sizeof(*ev));
+  if (!ev) {
+    perror("malloc");
+    return(1);
+  }
+  srandom(1);
+
+  memset(&p, 0, sizeof(p));
+  p.gapsize = 1000;
+  p.runtmax = 10;
+  p.absaxis = -1;
+
+  p.mode = DETECT_KEY;
+  n = gen_key(ev, NEVENTS);
+  run("key", ev, n, &p);
+
+  p.mode = DETECT_ABS;
+  p.abshigh = 300;
+  p.abslow = 150;
+  n = gen_abs(ev, NEVENTS);
+  run("abs", ev, n, &p);
+
+  p.intensitymilli = 50;
+  run("abs+intens", ev, n, &p);
+
+  free(ev);
+  return(0);
+}
@@ -0,0 +1,608 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Tests for the sequence detector in detect.c.  Run by "make test".
+   Besides fixed cases, randomized press patterns are generated from
+   a fixed seed and the detector must recover every press exactly. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "detect.h"
+#include "check.h"
+
+#define MAXRECS 4096
+
+/* Sink that records everything it is given */
+typedef struct collector {
+  int n;
+  detrec_t rec[MAXRECS];
+  seq_t seq[MAXRECS];
+  char text[MAXRECS][MARKLEN];
+} collector_t;
+
+static void collect(void *arg, const detrec_t *rec)
+{
+  collector_t *c = arg;
+
+  if (c->n >= MAXRECS) return;
+  c->rec[c->n] = *rec;
+  if (rec->seq) c->seq[c->n] = *rec->seq;
+  if (rec->text) {
+    memcpy(c->text[c->n], rec->text, rec->len);
+    c->rec[c->n].text = c->text[c->n];
+  }
+  c->n++;
+}
+
+/* Clock under the control of the test */
+static mstime_t fake_clock(void *arg)
+{
+  return(*(mstime_t *) arg);
+}
+
+static detparams_t default_params()
+{
+  detparams_t p;
+
+  memset(&p, 0, sizeof(p));
+  p.gapsize = 1000;
+  p.runtmax = 10;
+  p.mode = DETECT_KEY;
+  p.absaxis = -1;
+  return(p);
+}
+
+static int count_kind(collector_t *c, int kind)
+{
+  int i, n = 0;
+
+  for (i = 0; i < c->n; i++) if (c->rec[i].kind == kind) n++;
+  return(n);
+}
+
+static void key1(detector_t *d, mstime_t t, int value)
+/* One key report as the pedal sends it: scan code, key, sync */
+{
+  detect_event(d, t, EV_MSC, MSC_SCAN, 0x7001e);
+  detect_event(d, t, EV_KEY, KEY_1, value);
+  detect_event(d, t, EV_SYN, SYN_REPORT, 0);
+}
+
+static void press(detector_t *d, mstime_t start, int len, int period)
+/* Hold the pedal from start for len milliseconds, autorepeating */
+{
+  mstime_t t;
+
+  key1(d, start, 1);
+  for (t = start + period; t < start + len; t += period) key1(d, t, 2);
+  key1(d, start + len, 0);
+}
+
+static void test_single_press()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+
+  detect_init(&d, &p, collect, c, 0, 0);
+  press(&d, 1637000000000LL, 990, 33);
+  detect_finish(&d);
+
+  CHECK(c->n == 2);
+  CHECK(c->rec[0].kind == REC_DOWN && c->rec[0].time == 1637000000000LL);
+  CHECK(c->rec[1].kind == REC_UP && c->rec[1].time == 1637000000990LL);
+  CHECK(c->rec[1].seqlen == 990);
+  CHECK(c->seq[1].key1count == 31);
+  CHECK(c->seq[1].evcount[EV_MSC] == 31);
+  CHECK(!c->seq[1].heldstart);
+  free(c);
+}
+
+static void test_runt()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+
+  detect_init(&d, &p, collect, c, 0, 0);
+  press(&d, 5000, 10, 33);   /* exactly runtmax: a runt */
+  press(&d, 10000, 11, 33);  /* one more: logged */
+  detect_finish(&d);
+
+  CHECK(count_kind(c, REC_RUNT) == 1);
+  CHECK(count_kind(c, REC_DOWN) == 1);
+  CHECK(count_kind(c, REC_UP) == 1);
+  free(c);
+}
+
+static void test_gap_boundary()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+
+  /* gapsize - 1 continues the sequence, gapsize ends it */
+  detect_init(&d, &p, collect, c, 0, 0);
+  press(&d, 0, 100, 33);
+  press(&d, 100 + p.gapsize - 1, 100, 33);
+  press(&d, 200 + 2*p.gapsize - 1, 100, 33);
+  detect_finish(&d);
+
+  CHECK(count_kind(c, REC_UP) == 2);
+  CHECK(c->rec[1].seqlen == 100 + p.gapsize - 1 + 100);
+  CHECK(c->rec[1].gap == p.gapsize);
+  free(c);
+}
+
+static void test_timer()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  mstime_t now = 0;
+
+  detect_init(&d, &p, collect, c, fake_clock, &now);
+  CHECK(detect_deadline(&d) == -1);
+  press(&d, 1000, 500, 33);
+  CHECK(detect_deadline(&d) == 1500 + p.gapsize);
+
+  now = 1500 + p.gapsize - 1;
+  CHECK(detect_poll(&d) == 0);
+  CHECK(count_kind(c, REC_DOWN) == 1);
+  CHECK(count_kind(c, REC_UP) == 0);
+
+  now = 1500 + p.gapsize;
+  CHECK(detect_poll(&d) == 1);
+  CHECK(count_kind(c, REC_UP) == 1);
+  CHECK(c->rec[1].gap == p.gapsize);
+  CHECK(detect_deadline(&d) == -1);
+  free(c);
+}
+
+static void test_clock_wrap()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  mstime_t t32 = 0x80000000LL * 1000;  /* 32-bit time_t wraps here */
+  mstime_t u32 = 0x100000000LL * 1000; /* and unsigned 32-bit here */
+
+  detect_init(&d, &p, collect, c, 0, 0);
+  press(&d, t32 - 500, 1000, 33);
+  press(&d, u32 - 300, 600, 33);
+  detect_finish(&d);
+
+  CHECK(count_kind(c, REC_UP) == 2);
+  CHECK(c->rec[0].time == t32 - 500);
+  CHECK(c->rec[1].seqlen == 1000);
+  CHECK(c->rec[3].seqlen == 600);
+  CHECK(c->rec[2].time == u32 - 300);
+  free(c);
+}
+
+static void test_clock_step_back()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+
+  /* Clock stepped back by an hour in the middle of a press: must not
+     produce a huge gap, nor a negative sequence length */
+  detect_init(&d, &p, collect, c, 0, 0);
+  press(&d, 10000000, 300, 33);
+  press(&d, 10000000 - 3600000, 300, 33);
+  detect_finish(&d);
+
+  CHECK(count_kind(c, REC_UP) == 1);
+  CHECK(c->rec[1].seqlen == 300);
+  free(c);
+}
+
+static void test_held_at_startup()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  mstime_t t;
+
+  /* First KEY_1 seen is an autorepeat */
+  detect_init(&d, &p, collect, c, 0, 0);
+  for (t = 0; t < 400; t += 33) key1(&d, t, 2);
+  key1(&d, 400, 0);
+  press(&d, 5000, 200, 33);
+  detect_finish(&d);
+
+  CHECK(count_kind(c, REC_UP) == 2);
+  CHECK(c->rec[0].kind == REC_DOWN && c->seq[0].heldstart);
+  CHECK(c->rec[1].seqlen == 400);
+  CHECK(!c->seq[2].heldstart);
+  free(c);
+}
+
+static void test_out_of_order_property()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  mstime_t t, start[100], end[100];
+  int round, k, npress, ok;
+
+  /* Two device nodes report the same presses; their events reach the
+     detector node by node, so timestamps go back by up to a read
+     batch.  Every press must still come out exactly once. */
+  srandom(29);
+  for (round = 0; round < 200; round++) {
+    c->n = 0;
+    detect_init(&d, &p, collect, c, 0, 0);
+    npress = 1 + random() % 50;
+    t = 1637000000000LL + random() % 100000;
+    for (k = 0; k < npress; k++) {
+      start[k] = t;
+      end[k] = t + 20 + random() % 3000;
+      t = end[k] + p.gapsize + random() % 5000;
+    }
+    for (k = 0; k < npress; k++) {
+      mstime_t s, batch;
+      for (s = start[k]; s <= end[k]; s += batch) {
+	/* node 0 then node 1, each with a batch of events */
+	mstime_t e, stop;
+	batch = 33 * (1 + random() % 4);
+	stop = s + batch > end[k] ? end[k] + 1 : s + batch;
+	for (e = s; e < stop; e += 33) key1(&d, e, e == s ? 1 : 2);
+	for (e = s; e < stop; e += 33) detect_event(&d, e, EV_REL, REL_X, 1);
+      }
+      key1(&d, end[k], 0);
+    }
+    detect_finish(&d);
+
+    ok = (count_kind(c, REC_UP) == npress);
+    for (k = 0; ok && k < npress; k++) {
+      ok = c->rec[2*k].time == start[k] && c->rec[2*k+1].time == end[k];
+    }
+    CHECK(ok);
+    if (!ok) break;
+  }
+  free(c);
+}
+
+static void test_poll_matches_event_gap_property()
+{
+  detparams_t p = default_params();
+  collector_t *a = calloc(1, sizeof(*a)), *b = calloc(1, sizeof(*b));
+  detector_t da, db;
+  mstime_t now, t;
+  int round, k, same;
+
+  /* Ending sequences from the timer must give the same boundaries as
+     ending them on the next event */
+  srandom(30);
+  for (round = 0; round < 200; round++) {
+    a->n = b->n = 0;
+    now = 0;
+    detect_init(&da, &p, collect, a, fake_clock, &now);
+    detect_init(&db, &p, collect, b, 0, 0);
+    t = 0;
+    for (k = 0; k < 30; k++) {
+      t += random() % 2500;
+      now = t;
+      detect_poll(&da);
+      key1(&da, t, 1);
+      key1(&db, t, 1);
+    }
+    detect_finish(&da);
+    detect_finish(&db);
+
+    same = a->n == b->n;
+    for (k = 0; same && k < a->n; k++) {
+      same = a->rec[k].kind == b->rec[k].kind && a->rec[k].time == b->rec[k].time
+	&& a->rec[k].seqlen == b->rec[k].seqlen;
+    }
+    CHECK(same);
+    if (!same) break;
+  }
+  free(a);
+  free(b);
+}
+
+static void test_markers()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  int kinds[] = {REC_MARKER, REC_MARKER, REC_DOWN, REC_MARKER, REC_UP,
+		 REC_MARKER, REC_RUNT, REC_MARKER};
+  int i, n = sizeof(kinds)/sizeof(kinds[0]);
+
+  detect_init(&d, &p, collect, c, 0, 0);
+  detect_marker(&d, 100, "A", 1);     /* no sequence: out at once */
+  key1(&d, 200, 1);
+  detect_marker(&d, 190, "B", 1);     /* stamped before the DOWN */
+  detect_marker(&d, 250, "C", 1);     /* inside the press */
+  key1(&d, 300, 2);
+  key1(&d, 400, 0);
+  detect_marker(&d, 900, "D", 1);     /* in the gap after the press */
+  key1(&d, 2000, 1);                  /* ends press, starts a runt */
+  detect_marker(&d, 2005, "E", 1);
+  detect_finish(&d);
+
+  CHECK(c->n == n);
+  for (i = 0; i < n && i < c->n; i++) CHECK(c->rec[i].kind == kinds[i]);
+  CHECK(c->rec[0].len == 1 && c->rec[0].text[0] == 'A');
+  CHECK(c->rec[1].text[0] == 'B');
+  CHECK(c->rec[7].text[0] == 'E');
+  detect_free(&d);
+  free(c);
+}
+
+static void test_marker_order_property()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  mstime_t t, last;
+  int round, i, nmarks, ok;
+
+  /* Markers at random times among random presses: every marker comes
+     out exactly once, and all records are in time order */
+  srandom(31);
+  for (round = 0; round < 200; round++) {
+    c->n = 0;
+    nmarks = 0;
+    detect_init(&d, &p, collect, c, 0, 0);
+    for (i = 0, t = 0; i < 1000 && c->n < MAXRECS - 100; i++) {
+      t += random() % 400;
+      if (random() % 3) key1(&d, t, 1);
+      else {
+	detect_marker(&d, t, "x", 1);
+	nmarks++;
+      }
+    }
+    detect_finish(&d);
+
+    ok = (count_kind(c, REC_MARKER) == nmarks);
+    for (i = 0, last = 0; ok && i < c->n; i++) {
+      if (c->rec[i].kind == REC_RUNT) continue; /* not in the log */
+      ok = c->rec[i].time >= last;
+      last = c->rec[i].time;
+    }
+    CHECK(ok);
+    detect_free(&d);
+    if (!ok) break;
+  }
+  free(c);
+}
+
+/* One input event, for wakeup() */
+typedef struct ev {
+  mstime_t t;
+  int type, code, value;
+} ev_t;
+
+static void wakeup(detector_t *d, const mstime_t *mark, int nmark, const ev_t *ev, int nev)
+/* One wakeup of logevents(): the markers were received before the
+   events were read, and each goes to the detector just before the
+   first event stamped after it, the rest after the last event */
+{
+  int i, m = 0;
+
+  for (i = 0; i < nev; i++) {
+    for (; m < nmark && mark[m] < ev[i].t; m++) detect_marker(d, mark[m], "m", 1);
+    detect_event(d, ev[i].t, ev[i].type, ev[i].code, ev[i].value);
+  }
+  for (; m < nmark; m++) detect_marker(d, mark[m], "m", 1);
+}
+
+static void test_marker_late_delivery()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  mstime_t mark1[] = {100}, mark2[] = {70};
+  ev_t press1[] = {{110, EV_KEY, KEY_1, 1}, {140, EV_KEY, KEY_1, 2},
+		   {170, EV_KEY, KEY_1, 2}, {200, EV_KEY, KEY_1, 0}};
+  ev_t press2[] = {{20, EV_ABS, ABS_Z, 600}, {50, EV_ABS, ABS_Z, 700},
+		   {80, EV_ABS, ABS_Z, 650}, {90, EV_ABS, ABS_Z, 100}};
+
+  /* A marker received during the sleep, then a press after it in the
+     same wakeup: the marker is logged first */
+  detect_init(&d, &p, collect, c, 0, 0);
+  wakeup(&d, mark1, 1, press1, 4);
+  detect_finish(&d);
+  CHECK(c->n == 3);
+  CHECK(c->rec[0].kind == REC_MARKER && c->rec[0].time == 100);
+  CHECK(c->rec[1].kind == REC_DOWN && c->rec[1].time == 110);
+  CHECK(c->rec[2].kind == REC_UP && c->rec[2].time == 200);
+  detect_free(&d);
+
+  /* A whole abs press in one wakeup, with a marker inside it */
+  c->n = 0;
+  p.mode = DETECT_ABS;
+  p.abshigh = 500;
+  p.abslow = 200;
+  detect_init(&d, &p, collect, c, 0, 0);
+  wakeup(&d, mark2, 1, press2, 4);
+  detect_finish(&d);
+  CHECK(c->n == 3);
+  CHECK(c->rec[0].kind == REC_DOWN && c->rec[0].time == 20);
+  CHECK(c->rec[1].kind == REC_MARKER && c->rec[1].time == 70);
+  CHECK(c->rec[2].kind == REC_UP);
+  detect_free(&d);
+  free(c);
+}
+
+static void test_marker_wakeup_property()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  mstime_t mark[64], t, tm, last;
+  ev_t ev[64];
+  int round, w, i, nmark, nev, total, ok;
+
+  /* As test_marker_order_property(), but with markers and key events
+     arriving in 100 ms wakeups the way logevents() takes them */
+  srandom(32);
+  for (round = 0; round < 200; round++) {
+    c->n = 0;
+    total = 0;
+    detect_init(&d, &p, collect, c, 0, 0);
+    for (w = 0, t = 0; w < 200 && c->n < MAXRECS - 200; w++, t += 100) {
+      nmark = random() % 4;
+      for (i = 0, tm = t; i < nmark; i++) mark[i] = tm += random() % 30;
+      nev = random() % 3 ? 0 : random() % 8;
+      for (i = 0; i < nev; i++) {
+	ev[i].t = t + 12*i + random() % 12;
+	ev[i].type = EV_KEY;
+	ev[i].code = KEY_1;
+	ev[i].value = 1;
+      }
+      wakeup(&d, mark, nmark, ev, nev);
+      total += nmark;
+    }
+    detect_finish(&d);
+
+    ok = (count_kind(c, REC_MARKER) == total);
+    for (i = 0, last = 0; ok && i < c->n; i++) {
+      if (c->rec[i].kind == REC_RUNT) continue; /* not in the log */
+      ok = c->rec[i].time >= last;
+      last = c->rec[i].time;
+    }
+    CHECK(ok);
+    detect_free(&d);
+    if (!ok) break;
+  }
+  free(c);
+}
+
+static void test_abs_hysteresis()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  int values[] = {0, 100, 400, 520, 480, 510, 490, 700, 900, 600, 250, 190, 0};
+  int i, n = sizeof(values)/sizeof(values[0]);
+
+  p.mode = DETECT_ABS;
+  p.abshigh = 500;
+  p.abslow = 200;
+  detect_init(&d, &p, collect, c, 0, 0);
+  for (i = 0; i < n; i++) {
+    detect_event(&d, 1000 + 10*i, EV_ABS, ABS_Z, values[i]);
+    detect_event(&d, 1000 + 10*i, EV_SYN, SYN_REPORT, 0);
+  }
+  CHECK(detect_deadline(&d) == -1);
+  detect_finish(&d);
+
+  /* noise around 500 does not split; press from 520 to release at 190 */
+  CHECK(count_kind(c, REC_UP) == 1);
+  CHECK(c->rec[0].time == 1030);
+  CHECK(c->rec[1].time == 1110);
+  CHECK(c->seq[1].absmin == 190 && c->seq[1].absmax == 900);
+  CHECK(c->seq[1].absspan == 80);
+  CHECK(c->seq[1].absintegral == 10.0*(520+480+510+490+700+900+600+250));
+  free(c);
+}
+
+static void test_intensity_decimation()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  detector_t d;
+  int i;
+
+  /* 1 kHz samples, 50 ms intervals: 20 records per second */
+  p.intensitymilli = 50;
+  detect_init(&d, &p, collect, c, 0, 0);
+  for (i = 0; i < 1000; i++) detect_event(&d, 100000 + i, EV_ABS, ABS_Z, i % 97);
+  detect_finish(&d);
+
+  CHECK(count_kind(c, REC_INTENSITY) == 20);
+  CHECK(c->rec[0].time == 100000 && c->rec[0].value == 49);
+  free(c);
+}
+
+/* Trace hook that records what it is told */
+typedef struct tracelog {
+  int n;
+  int what[MAXRECS];
+  mstime_t time[MAXRECS], value[MAXRECS];
+} tracelog_t;
+
+static void tracelog(void *arg, int what, mstime_t time, mstime_t value)
+{
+  tracelog_t *t = arg;
+
+  if (t->n >= MAXRECS) return;
+  t->what[t->n] = what;
+  t->time[t->n] = time;
+  t->value[t->n] = value;
+  t->n++;
+}
+
+static void test_trace_hook()
+{
+  detparams_t p = default_params();
+  collector_t *c = calloc(1, sizeof(*c));
+  tracelog_t *t = calloc(1, sizeof(*t));
+  detector_t d;
+  int i;
+
+  /* a KEY_1 that ends one sequence and starts the next */
+  detect_init(&d, &p, collect, c, 0, 0);
+  detect_settrace(&d, tracelog, t);
+  key1(&d, 1000, 1);
+  key1(&d, 1500, 0);
+  key1(&d, 2500, 1);
+  detect_finish(&d);
+  CHECK(t->n == 4);
+  CHECK(t->what[0] == DETTRACE_START && t->time[0] == 1000);
+  CHECK(t->what[1] == DETTRACE_GAP && t->value[1] == 500);
+  CHECK(t->what[2] == DETTRACE_GAPEND && t->time[2] == 2500 && t->value[2] == 1000);
+  CHECK(t->what[3] == DETTRACE_START && t->time[3] == 2500);
+
+  /* in abs mode a gap never ends a sequence */
+  memset(t, 0, sizeof(*t));
+  p.mode = DETECT_ABS;
+  p.abshigh = 500;
+  p.abslow = 200;
+  detect_init(&d, &p, collect, c, 0, 0);
+  detect_settrace(&d, tracelog, t);
+  detect_event(&d, 1000, EV_ABS, ABS_Z, 600);
+  detect_event(&d, 5000, EV_ABS, ABS_Z, 700);
+  detect_event(&d, 5000, EV_KEY, KEY_1, 1);
+  detect_event(&d, 6000, EV_ABS, ABS_Z, 100);
+  detect_finish(&d);
+  for (i = 0; i < t->n; i++) CHECK(t->what[i] != DETTRACE_GAPEND);
+  CHECK(t->n >= 1 && t->what[0] == DETTRACE_START && t->time[0] == 1000);
+  free(t);
+  free(c);
+}
+
+int main()
+{
+  test_single_press();
+  test_runt();
+  test_gap_boundary();
+  test_timer();
+  test_clock_wrap();
+  test_clock_step_back();
+  test_held_at_startup();
+  test_out_of_order_property();
+  test_poll_matches_event_gap_property();
+  test_markers();
+  test_marker_order_property();
+  test_marker_late_delivery();
+  test_marker_wakeup_property();
+  test_abs_hysteresis();
+  test_intensity_decimation();
+  test_trace_hook();
+
+  return(check_result("detect_test", 0));
+}
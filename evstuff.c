@@ -33,12 +33,19 @@
 #include <getopt.h>
 #include <ctype.h>
 #include <signal.h>
+#include <poll.h>
 #include <sys/time.h>
 #include <time.h>
+#include <stdarg.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "footlog.h"
+#include "stats.h"
+#include "occupancy.h"
+#include "crc32c.h"
+#include "trace.h"
+#include "pedal.h"
 
 #define BITS_PER_LONG (sizeof(long) * 8)
 #define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
@@ -48,7 +55,6 @@
 #define test_bit(bit, array)	((array[LONG(bit)] >> OFF(bit)) & 1)
 
 #define DEV_INPUT_EVENT "/dev/input"
-#define EVENT_DEV_NAME "event"
 
 /*
    To find definitions of event codes such as EV_MAX, EV_SYN, etc. look in:
@@ -75,36 +81,13 @@
 static int grab_flag = 0;
 
 /* evdevices are devices on which to listen for events */
-#define EVDEVMAX  6 /* maximum number of event devices; 1 or 2 is typical */
+#define EVDEVMAX PEDALDEVMAX /* maximum number of event devices */
 static int evdevcount = 0; /* actual number of event devices discovered */
 static char *evdevpathname[EVDEVMAX] = {0,}; /* pathnames of above devices, 
 						all initialized to null */
 static int evdevfd[EVDEVMAX] = {-1,}; /* array of open fds of above devices */
 int evmilli = 100; /* Number of milliseconds to sleep between event checks */
 
-/* The following structure keeps together all the parts relating to a
-   sequence of events that will be reported in an "UP" log entry at
-   the end of the sequence */
-typedef struct sequence {
-  /* FirstOne_{sec,msec} marks the first of a (possibly long) sequence
-   of KEY_1 events.  LastOne_{sec,msec} marks the most recent KEY_1
-   event.  The sequence is ended by a gap of at least GapSize
-   milliseconds before the next KEY_1 event. All other events are
-   ignored for purposes of timing/logging.  */
-  int FirstOne_sec;
-  int FirstOne_msec;
-  int LastOne_sec;
-  int LastOne_msec;
-
-  /* Cumulative event stats within current sequence. Reset to zero at
-     start of current sequence.  We keep track of KEY_1 events
-     separately in key1count.  All other EV_KEY events are lumped
-     together in evcount[]
- */
-  int key1count; /* how many KEY_1 events */
-  int evcount[EV_MAX]; /* how many of each type of event */
-} seq_t;;
-
 
 /* 
    All the static const char* definitions below are brutally shortened
@@ -120,6 +103,7 @@ static const char * const events[EV_MAX + 1] = {
   [0 ... EV_MAX] = NULL,
   NAME_ELEMENT(EV_SYN),			
   NAME_ELEMENT(EV_KEY),
+  NAME_ELEMENT(EV_ABS),
   NAME_ELEMENT(EV_MSC)
 };
 
@@ -127,6 +111,7 @@ static const int maxval[EV_MAX + 1] = {
   [0 ... EV_MAX] = -1,
   [EV_SYN] = SYN_MAX,
   [EV_KEY] = KEY_MAX,
+  [EV_ABS] = ABS_MAX,
   [EV_MSC] = MSC_MAX
 };
 
@@ -135,6 +120,23 @@ static const char * const keys[KEY_MAX + 1] = {
   NAME_ELEMENT(KEY_1) /* only one retained from evtest.c */
 };
 
+/* Axes that analog and pressure-sensitive pedals are known to use */
+static const char * const absval[ABS_MAX + 1] = {
+  [0 ... ABS_MAX] = NULL,
+  NAME_ELEMENT(ABS_X),
+  NAME_ELEMENT(ABS_Y),
+  NAME_ELEMENT(ABS_Z),
+  NAME_ELEMENT(ABS_RX),
+  NAME_ELEMENT(ABS_RY),
+  NAME_ELEMENT(ABS_RZ),
+  NAME_ELEMENT(ABS_THROTTLE),
+  NAME_ELEMENT(ABS_RUDDER),
+  NAME_ELEMENT(ABS_WHEEL),
+  NAME_ELEMENT(ABS_GAS),
+  NAME_ELEMENT(ABS_BRAKE),
+  NAME_ELEMENT(ABS_PRESSURE)
+};
+
 static const char * const misc[MSC_MAX + 1] = {
   [ 0 ... MSC_MAX] = NULL,
   NAME_ELEMENT(MSC_SCAN) /* only one retained from evtest.c */
@@ -153,6 +155,7 @@ static const char * const * const names[EV_MAX + 1] = {
   [0 ... EV_MAX] = NULL,
   [EV_SYN] = syns,  
   [EV_KEY] = keys,
+  [EV_ABS] = absval,
   [EV_MSC] = misc
 };
 
@@ -183,60 +186,72 @@ static int test_grab(int fd, int grab_flag)
   return rc;
 }
 
-static int is_event_device(const struct dirent *dir) {
-/* Filter for scandir() in scan_devices() 
-   Returns 1 (TRUE) if given directory entry starts with "event"
-   Returns 0 (FALSE)  otherwise
-*/
-  int rc = 0;
-  rc = strncmp(EVENT_DEV_NAME, dir->d_name, 5);
-  if (!rc) return (1);
-  else return(0);
+static void abs_thresholds()
+/* Resolve AbsAxis on the grabbed devices, and derive whichever of
+   AbsHigh and AbsLow were not given on the command line from its
+   range.  Exit if no axis is found. */
+{
+  if (pedal_abs_thresholds(evdevfd, evdevcount, &AbsAxis, &AbsHigh, &AbsLow,
+			   AbsHighSet, AbsLowSet) < 0) {
+    if (AbsAxis >= 0) fprintf(stderr, "Axis %d not found on footpedal\n", AbsAxis);
+    else fprintf(stderr, "No EV_ABS axis found on footpedal\n");
+    exit(-1);
+  }
+  if (DebugFlag) fprintf(stderr, "Axis %d (%s): AbsHigh = %d  AbsLow = %d\n",
+			 AbsAxis, codename(EV_ABS, AbsAxis), AbsHigh, AbsLow);
+}
+
+/* Events per second assumed for sizing the capture file */
+#define CAPREPEVENTS 3    /* per key repeat: EV_MSC, EV_KEY, EV_SYN */
+#define CAPABSRATE 2000   /* for a device with an analog axis */
+#define CAPMINRATE 100    /* floor, for devices that report neither */
+
+static int capture_rate()
+/* Estimate the maximum number of events per second from all grabbed
+   devices together, from their key repeat period and whether they
+   have an analog axis */
+{
+  unsigned int rep[2];
+  unsigned long evbits[NBITS(EV_CNT)];
+  int i, rate = 0;
+
+  for (i = 0; i < evdevcount; i++) {
+    if (!ioctl(evdevfd[i], EVIOCGREP, rep) && rep[1] > 0)
+      rate += CAPREPEVENTS * 1000 / rep[1];
+
+    memset(evbits, 0, sizeof(evbits));
+    if (ioctl(evdevfd[i], EVIOCGBIT(0, sizeof(evbits)), evbits) >= 0
+	&& test_bit(EV_ABS, evbits))
+      rate += CAPABSRATE;
+  }
+  if (rate < CAPMINRATE) rate = CAPMINRATE;
+  if (DebugFlag) fprintf(stderr, "Capture sized for %d events/second\n", rate);
+  return(rate);
 }
 
 void scan_devices()
 /* Fills the globals pertaining to evdevices by discovering them
    in /dev/input/event* */
 {
-  struct dirent **namelist;
-  int i, rc, fd, ndev, devnum;
-  int max_device = 0;
-  char fname[BUFLEN], name[256], target[BUFLEN];
-  char *where;
-
-  ndev = scandir(DEV_INPUT_EVENT, &namelist, is_event_device, versionsort);
-  if (ndev <= 0) return;
-
-  if (DebugFlag) fprintf(stderr, "%d available devices:\n", ndev);
-  for (i = 0; i < ndev; i++) {
-    snprintf(fname, sizeof(fname),
-	     "%s/%s", DEV_INPUT_EVENT, namelist[i]->d_name);
-    if (DebugFlag) fprintf(stderr, "%s", fname);
-    fd = -1;
-    fd = open(fname, O_RDONLY);
-    if (fd < 0)	continue; /* don't know why it failed, just ignore */
-
-    sprintf(name, "???");
-    ioctl(fd, EVIOCGNAME(sizeof(name)), name);
-    if (DebugFlag) fprintf(stderr, ":%s\n", name);
-    close(fd);
-
-    snprintf (target, sizeof(target)-1, "HID %s:%s", fpid1, fpid2);
-    where = strstr(name, target);
-    if (where) {/* match found! */
-      if (evdevcount >= EVDEVMAX) {
-	fprintf(stderr, "Too many event devices, evdevcount = %d\n", 
-		evdevcount);
-	exit(-1);
-      }
-      if (DebugFlag) fprintf(stderr, "Found target: %s\n", where);
-      evdevpathname[evdevcount] = strdup(fname);
-      if (DebugFlag) fprintf(stderr, "evdevpathname[%d] = \"%s\"\n", 
-			     evdevcount, evdevpathname[evdevcount]);
-      evdevcount++;
-    }
+  char path[EVDEVMAX][PEDALPATHLEN];
+  int i, rc;
 
-    free(namelist[i]); /* allocated in bulk by scandir (); free one by one */
+  evdevcount = pedal_find_devices(fpid1, fpid2, path, EVDEVMAX);
+  if (evdevcount < 0) {
+    if (errno == E2BIG) {
+      fprintf(stderr, "Too many event devices, more than %d\n", EVDEVMAX);
+      exit(-1);
+    }
+    if (errno != ENODEV) {
+      perror(DEV_INPUT_EVENT);
+      exit(-1);
+    }
+    evdevcount = 0;
+  }
+  for (i = 0; i < evdevcount; i++) {
+    evdevpathname[i] = strdup(path[i]);
+    if (DebugFlag) fprintf(stderr, "evdevpathname[%d] = \"%s\"\n", 
+			   i, evdevpathname[i]);
   }
 
   /* Open the event devices, obtain fds for them, and grab them */
@@ -257,111 +272,290 @@ void scan_devices()
     }
   }
 
+  if (CaptureFlag) capture_open(capture_rate(), evdevcount);
+
+  if (DetectMode == DETECT_ABS) {
+    /* Always resolve the axis, even with both thresholds given:
+       thresholds in one axis's units mean nothing for the others */
+    abs_thresholds();
+    if (AbsLow >= AbsHigh) {
+      fprintf(stderr, "AbsLow (%d) must be below AbsHigh (%d)\n", AbsLow, AbsHigh);
+      exit(-1);
+    }
+  }
 }
 
 
-static void StartSequence(seq_t *cs, int now_sec, int now_msec)
-   /* Using now_sec and now_msec as current time, initialize the
-      sequence pointed to by cs and log the start */
-{
-  cs->FirstOne_sec = now_sec;
-  cs->FirstOne_msec = now_msec;
-  cs->LastOne_sec = now_sec;
-  cs->LastOne_msec = now_msec;
+/* Rolling-window statistics, when a snapshot file was asked for */
+static stats_t Stats;
+static int StatsOn = 0;
+static mstime_t StatsNext; /* time of next snapshot */
 
-  /*We shouldn't yet log the start of this sequence because it may
-    prove to be a runt; do both UP and DOWN in EndSequence()  */
-}
 
+/* Log record being put together; see log_add() and log_put() */
+static char logline[BUFLEN];
+static int loglen = 0;
 
-static void EndSequence(seq_t *cs, int gapsize)
-/* gapsize is input parameter, expressed in milliseconds */
+static void log_add(const char *fmt, ...)
+/* Append to the log record being put together */
 {
-  int seqlen, k;
-
-  /* End previous sequence */
-  seqlen = (cs->LastOne_sec - cs->FirstOne_sec)*1000 + (cs->LastOne_msec - cs->FirstOne_msec);
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(logline + loglen, sizeof(logline) - loglen, fmt, ap);
+  va_end(ap);
+  if (n > 0) loglen += n;
+  if (loglen >= (int) sizeof(logline)) loglen = sizeof(logline) - 1; /* truncated */
+}
 
-  /* Sequence ended at LastOne, which was at least GapSize milliseconds ago.
-     Log the end of this sequence */
+static void log_put()
+/* Write the record put together to LogFile as one line, unchanged
+   but for the CRC32C of its text appended, so that footverify can
+   tell exactly which records of an archived log were damaged */
+{
+  fprintf(LogFile, "%.*s" CRCTAG "%08x\n", loglen, logline,
+	  crc32c(0, logline, loglen));
+  loglen = 0;
+}
 
-  /* Ignore very short sequences as runts */
-#define RUNTMAX 10  /* Sequences shorter than this number of milliseconds are runts */
-  if (seqlen > RUNTMAX) {
-    fprintf(LogFile, "%u.%03u: DOWN\n", cs->FirstOne_sec, cs->FirstOne_msec);
-    fprintf(LogFile, "%u.%03u: UP  seqlen = %d ms  key1count = %d  gap = %d ms  ", 
-	   cs->LastOne_sec, cs->LastOne_msec, seqlen, cs->key1count, gapsize);
-    fprintf(LogFile, "evcounts:  ");
+static void log_sink(void *arg, const detrec_t *rec)
+/* Detector sink for the daemon and for replay: write sequences to
+   LogFile and intensity samples to IntensityFile */
+{
+  const seq_t *cs = rec->seq;
+  int k;
+
+  (void) arg;
+  switch (rec->kind) {
+  case REC_DOWN:
+    if (StatsOn) stats_down(&Stats, rec->time);
+    log_add("%lld.%03lld: DOWN%s", (long long) rec->time/1000,
+	    (long long) rec->time%1000, cs->heldstart ? "  held at startup" : "");
+    log_put();
+    break;
+
+  case REC_UP:
+    if (StatsOn) stats_up(&Stats, rec->time);
+    if (OccupancyFd >= 0 && occ_append(OccupancyFd, rec->time - rec->seqlen, rec->time) < 0)
+      perror(OccupancyFileName); /* the log line matters more; carry on */
+    log_add("%lld.%03lld: UP  seqlen = %d ms  key1count = %d  gap = %d ms  ", 
+	    (long long) rec->time/1000, (long long) rec->time%1000,
+	    rec->seqlen, cs->key1count, rec->gap);
+    log_add("evcounts:  ");
     for (k = 0; k < EV_MAX; k++) {
       if (!cs->evcount[k]) continue;
-      else fprintf(LogFile, "%s = %d  ", typename(k), cs->evcount[k]);
+      else log_add("%s = %d  ", typename(k), cs->evcount[k]);
+    }
+    if (cs->abscount) {
+      /* time-weighted mean when the samples span some time */
+      log_add("abs:  min = %d  max = %d  mean = %.1f  integral = %.0f  ",
+	      cs->absmin, cs->absmax,
+	      cs->absspan ? cs->absintegral/cs->absspan : (double) cs->abssum/cs->abscount,
+	      cs->absintegral);
     }
-    fprintf(LogFile, "\n");
+    log_put();
     fflush(LogFile);
+    trace(TR_END, 0, rec->seqlen, rec->time, REC_UP);
+
+    /* Intensity stream is flushed at the same points as the log, so
+       its cost stays at one write() per sequence */
+    if (IntensityFile) fflush(IntensityFile);
+    break;
+
+  case REC_RUNT:
+    trace(TR_END, 0, rec->seqlen, rec->time, REC_RUNT);
+    if (DebugFlag) fprintf(stderr, "Runt of seqlen %d ms ignored \n", rec->seqlen);
+    if (IntensityFile) fflush(IntensityFile);
+    break;
+
+  case REC_MARKER:
+    log_add("%lld.%03lld: MARK %.*s", (long long) rec->time/1000,
+	    (long long) rec->time%1000, rec->len, rec->text);
+    log_put();
+    break;
+
+  case REC_INTENSITY:
+    fprintf(IntensityFile, "%lld.%03lld: %d\n", (long long) rec->time/1000,
+	    (long long) rec->time%1000, rec->value);
+    break;
   }
-  else {
-    if (DebugFlag) fprintf(stderr, "Runt of seqlen %d ms ignored \n", seqlen);
+}
+
+
+static void detector_params(detparams_t *p)
+/* Collect detector parameters from the command line globals */
+{
+  p->gapsize = GapSize;
+  p->runtmax = RuntMax;
+  p->mode = DetectMode;
+  p->absaxis = AbsAxis;
+  p->abshigh = AbsHigh;
+  p->abslow = AbsLow;
+  p->intensitymilli = IntensityFile ? IntensityMilli : 0;
+}
+
+
+static void stats_start(mstime_t now)
+/* Set up the windows listed in StatsList, counting from now */
+{
+  int seconds[STATSMAXWIN], n = 0;
+  char *p = StatsList, *end;
+
+  while (*p) {
+    if (n >= STATSMAXWIN) {
+      fprintf(stderr, "At most %d statistics windows\n", STATSMAXWIN);
+      exit(-1);
+    }
+    seconds[n] = strtol(p, &end, 10);
+    if (end == p || seconds[n] <= 0 || (*end && *end != ',')) {
+      fprintf(stderr, "Bad statistics window list: %s\n", StatsList);
+      exit(-1);
+    }
+    n++;
+    p = *end ? end + 1 : end;
   }
 
-  /* Initialize to detect the next sequence.  All values in cs remain
-     zero until first new KEY_1 event. That's when a a new sequence starts */
+  stats_init(&Stats, seconds, n, now);
+  StatsOn = 1;
+  StatsNext = now + StatsMilli;
+}
+
+static void stats_snapshot(detector_t *det, mstime_t now)
+/* Rewrite StatsFileName if it is time to.  A press still in progress
+   is credited as far as the detector knows it to be down */
+{
+  if (!StatsOn || now < StatsNext) return;
+
+  stats_credit(&Stats, detect_downthrough(det));
+  if (stats_write(&Stats, now, StatsFileName) < 0) perror(StatsFileName);
+  StatsNext = now + StatsMilli;
+}
+
+
+/* Events read from each device node in one wakeup, merged by
+   timestamp; see pedal.h */
+static pedalmerge_t merge;
+
+static void trace_detector(void *arg, int what, mstime_t time, mstime_t value)
+/* Detector trace hook; arg points at the index of the device whose
+   event is being handled */
+{
+  int dev = *(int *) arg;
 
-  bzero(cs, sizeof(seq_t));
+  if (what == DETTRACE_START) trace(TR_START, dev, 0, time, 0);
+  else trace(TR_GAP, dev, value, what == DETTRACE_GAPEND, 0);
+}
+
+static volatile sig_atomic_t stopsig = 0;
+
+static void stop_on_signal(int sig)
+/* SIGTERM, SIGINT and SIGHUP: leave logevents() at the next wakeup */
+{
+  stopsig = sig;
 }
 
 void  logevents()
 {
-  struct input_event ev[64];
-  int i, j, numev, rd, fdlimit, rc;
+  struct input_event *e;
+  int i, j, k, numev, rd, fdlimit, rc;
   fd_set fdmask;
-  seq_t curseq;  /* bookeeping for current sequence */
-  struct timeval select_timeout;
+  detector_t det;  /* bookeeping for current sequence */
+  detparams_t params;
+  struct timespec select_timeout;
+  struct pollfd markpoll;
+  struct sigaction sa;
+  sigset_t stopmask, waitmask;
+  mstime_t deadline, wait;
   div_t divresult;
 
-  /* Initialize select_timeout; unchanged after start */
-  divresult = div(GapSize, 1000);
-  select_timeout.tv_sec = divresult.quot;
-  select_timeout.tv_usec = (divresult.rem)*1000; /* in microseconds */
+  detector_params(&params);
+  detect_init(&det, &params, log_sink, 0, pedal_clock, 0);
+  if (tracebuf) detect_settrace(&det, trace_detector, &j);
+  if (StatsFileName[0]) stats_start(pedal_clock(0));
 
   /* find value of "nfds" to use in select()  */
   fdlimit = 0; /* one greater than highest numbered fd */
   for (i = 0; i < evdevcount; i++) {
     if (evdevfd[i] > fdlimit) fdlimit = evdevfd[i] + 1;
   }
-
-  /* Initialize current sequence */
-  bzero(&curseq, sizeof(curseq)); /* everything is an int, so safe */
-
-  /* Listen forever until terminated by signal */
-  while (1) {
+  if (MarkerFd >= fdlimit) fdlimit = MarkerFd + 1;
+  merge.ndev = evdevcount;
+
+  /* Stop cleanly on SIGTERM, SIGINT or SIGHUP, so that buffered
+     capture records reach the disk.  They are blocked except while
+     waiting in pselect(), so that one arriving just before the wait
+     can't be missed until the next event */
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_handler = stop_on_signal;
+  sigaction(SIGTERM, &sa, 0);
+  sigaction(SIGINT, &sa, 0);
+  sigaction(SIGHUP, &sa, 0);
+  sigemptyset(&stopmask);
+  sigaddset(&stopmask, SIGTERM);
+  sigaddset(&stopmask, SIGINT);
+  sigaddset(&stopmask, SIGHUP);
+  sigprocmask(SIG_BLOCK, &stopmask, &waitmask);
+
+  /* Listen until terminated by signal */
+  while (!stopsig) {
     /* clean up fdmask from last iteration and set up for this one */
     FD_ZERO(&fdmask); 
     for (j = 0; j < evdevcount; j++) {
       FD_SET(evdevfd[j], &fdmask);
     }
-
-    /* If a sequence has already started, we need to timeout after
-       GapSize millieconds so that we can write out the log record in
-       a timely manner.  Otherwise, if a sequence has not started, we
-       can afford to block indefinitely. */
-
-    if (curseq.FirstOne_sec) {
-      rc = select(fdlimit, &fdmask, NULL, NULL, &select_timeout);
+    if (MarkerFd >= 0) FD_SET(MarkerFd, &fdmask);
+
+    /* If a sequence has already started, we need to timeout at its
+       deadline (GapSize after the last KEY_1) so that we can write
+       out the log record in a timely manner.  Otherwise, if a
+       sequence has not started, we can afford to block
+       indefinitely, unless a statistics snapshot is due first. */
+
+    deadline = detect_deadline(&det);
+    if (deadline < 0) capture_flush(); /* idle, so a good time for disk I/O */
+    if (StatsOn && (deadline < 0 || StatsNext < deadline)) deadline = StatsNext;
+    if (deadline >= 0) {
+      wait = deadline - pedal_clock(0);
+      if (wait < 0) wait = 0;
+      select_timeout.tv_sec = wait/1000;
+      select_timeout.tv_nsec = (wait%1000)*1000000; /* in nanoseconds */
+      rc = pselect(fdlimit, &fdmask, NULL, NULL, &select_timeout, &waitmask);
     }
-    else {
-      rc = select(fdlimit, &fdmask, NULL, NULL, NULL);
+    else rc = pselect(fdlimit, &fdmask, NULL, NULL, NULL, &waitmask);
+    trace(TR_WAKEUP, 0, rc, deadline >= 0 ? wait : -1, 0);
+
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      perror("pselect");
+      exit(-1);
     }
 
     if (!rc) {/* timeout happened */
-      EndSequence(&curseq, GapSize);
+      detect_poll(&det);
+      fflush(LogFile); /* markers held back until the UP that just ended */
+      stats_snapshot(&det, pedal_clock(0));
       continue; /* outer while loop */
     }
     
-    /* Some event happened; process all the fds that unblocked */
+    /* Markers first: then any event that happened before a marker
+       arrived is already waiting on its device when we read it below */
+    if (MarkerFd >= 0 && FD_ISSET(MarkerFd, &fdmask)) {
+      k = marker_recv();
+      trace(TR_MARKERS, 0, k, 0, 0);
+    }
+
+    /* Some event happened; read from all the fds that unblocked
+       before processing any of it.  The pedal shows up as several
+       nodes, and taking them one after another would present the
+       detector with timestamps out of order */
     for (j = 0; j < evdevcount; j++) {
+      merge.count[j] = 0;
+      merge.head[j] = 0;
       if (!FD_ISSET(evdevfd[j], &fdmask)) continue;
 
-      rd = read(evdevfd[j], ev, sizeof(ev));
+      rd = read(evdevfd[j], merge.buf[j], sizeof(merge.buf[j]));
       if (rd < (int) sizeof(struct input_event)) {
 	fprintf(stderr, "expected %d bytes, got %d\n",
 	       (int) sizeof(struct input_event), rd);
@@ -370,99 +564,95 @@ void  logevents()
       }
 
       numev = rd / sizeof(struct input_event);
-      if (DebugFlag) fprintf(stderr, "read %d events\n", numev);
-
-      for (i = 0; i < numev; i++) {
-	unsigned int type, code, value, sec, msec, gap;
-
-	/* Process next event */
-
-	type = ev[i].type;
-	code = ev[i].code;
-	value = ev[i].value;
-	sec = ev[i].time.tv_sec;
-	msec = ev[i].time.tv_usec/1000; /* milliseconds */
-	if (DebugFlag) fprintf(stderr, "FirstOne_sec = %d   FirstOne_msec = %d   LastOne_sec = %d  LastOne_msec = %d\n", 
-		curseq.FirstOne_sec, curseq.FirstOne_msec, curseq.LastOne_sec, curseq.LastOne_msec);
-	if (curseq.LastOne_sec) {
-	  gap = (sec - curseq.LastOne_sec)*1000 + (msec - curseq.LastOne_msec);
-	}
-	else gap = 0;
-
-	/* TODO: Add code here to handle the corner case that the
-	   footpedal was already pressed before footlog was started */
-
-	if (DebugFlag) fprintf(stderr,
-			       "Event: %u.%03u   gap = %d\n", sec, msec, gap); 
-
-	if (!curseq.FirstOne_sec) {/* very first event, no gap */
-	  if (DebugFlag) fprintf(stderr, "No KEY_1 seen yet to start sequence\n");
-	}
-	else {
-	  /* End current sequence; log it; reset counters */
-	  if (gap >= GapSize) EndSequence(&curseq, gap);
-	}
-
-	/* Tolerate slight skew here; We are counting this event even
-	   though new sequence has not yet begun. */
-	curseq.evcount[type]++; /* keep track of how events many of each type */
-
-	if (type == EV_SYN) {
-	  if (DebugFlag) fprintf(stderr, " ---- EV_SYN ----\n");
-	  continue;
-	}
-
-	/* Type is other than EV_SYN */
-	if (DebugFlag)	fprintf(stderr, "type %d (%s), code %d (%s)", 
-				type, typename(type), code, codename(type, code));
-
-	switch (type) {
-	case EV_MSC:
-	  if (DebugFlag) {
-	    if (code == MSC_RAW || code == MSC_SCAN)
-	      fprintf(stderr, ", value %02x\n", value);
-	    else
-	      fprintf(stderr, ", value %d\n", value);
-	  }
-	  break;
-
-	case EV_KEY:
-	  if (DebugFlag) {
-	    /* ignore value, seems to have no use */
-	    fprintf(stderr, "\n");
-	  }
-	  if (!strcmp(codename(type,code), "KEY_1")) {
-	    curseq.key1count++;
-	    if (curseq.FirstOne_sec == 0) {/* Begin new sequence */
-	      StartSequence (&curseq, sec, msec);
-	    }
-	    else{ /* continue current sequence */
-	      curseq.LastOne_sec = sec;
-	      curseq.LastOne_msec = msec;
-	    }
-	  }
-	  break;
-
-	default:
-	  break;
+      trace(TR_READ, j, rd, 0, 0);
+      merge.count[j] = numev;
+    }
 
-	}
-      }
+    /* Process them in kernel timestamp order, each marker just before
+       the first event stamped after it */
+    while ((e = pedal_merge_next(&merge, &j))) {
+      capture_event(j, e);
+      trace(TR_EVENT, j, e->type << 16 | e->code, e->value,
+	    (int64_t) e->time.tv_sec*1000000 + e->time.tv_usec);
+      marker_deliver(&det, pedal_evtime(e));
+      detect_event(&det, pedal_evtime(e), e->type, e->code, e->value);
     }
+    marker_deliver(&det, -1);
+
+    /* Markers and early DOWN lines are not flushed by log_sink();
+       one write per wakeup keeps a 1 kHz marker stream cheap */
+    fflush(LogFile);
+    stats_snapshot(&det, pedal_clock(0));
 
     /* sleep briefly before checking again */
     struct timespec tt;
     divresult = div(evmilli, 1000);
     tt.tv_sec = divresult.quot;
     tt.tv_nsec = (divresult.rem)*1000000; /* in nanoseconds */
-    if (DebugFlag) fprintf(stderr, "Sleep is %d seconds and %d millieconds\n",
-			 (int) tt.tv_sec, (int) (tt.tv_nsec/1000000));
+    trace(TR_SLEEP, 0, evmilli, 0, 0);
+
+    /* Markers keep coming meanwhile, and the kernel queues only
+       max_dgram_qlen of them (10 by default, 10 ms at 1 kHz), so with
+       a marker channel the sleep ends as soon as one arrives */
+    if (MarkerFd >= 0) {
+      markpoll.fd = MarkerFd;
+      markpoll.events = POLLIN;
+      while (poll(&markpoll, 1, evmilli) < 0) {
+	if (errno != EINTR) {
+	  perror("poll");
+	  exit(-1);
+	}
+      }
+      continue;
+    }
 
-    rc = nanosleep(&tt, 0);
-    if (rc) {
-      perror("nanosleep");
-      exit(-1);
+    /* SIGUSR1 (a trace dump) interrupts this, SA_RESTART or not;
+       sleep out the rest */
+    while (nanosleep(&tt, &tt) < 0) {
+      if (errno != EINTR) {
+	perror("nanosleep");
+	exit(-1);
+      }
     }
   }
+
+  if (DebugFlag) fprintf(stderr, "Stopping on signal %d\n", (int) stopsig);
+
+  /* A press in progress already has its DOWN in the log; end it, and
+     write out the markers held back with it */
+  detect_finish(&det);
+  fflush(LogFile);
+  detect_free(&det);
+  capture_close();
+}
+
+
+static mstime_t replay_clock(void *arg)
+/* Clock for replay: the time of the event about to be fed */
+{
+  return(*(mstime_t *) arg);
 }
 
+void replay_events(struct input_event *ev, long numev)
+/* Feed a captured event stream through the same detector as
+   logevents(), as fast as possible.  There is no select() here, so
+   the clock is the timestamp of the next event: the GapSize timeout
+   fires just before that event if it would have fired while waiting
+   for it.  The end of the stream acts as a final timeout. */
+{
+  detector_t det;
+  detparams_t params;
+  mstime_t now;
+  long i;
+
+  detector_params(&params);
+  detect_init(&det, &params, log_sink, 0, replay_clock, &now);
+
+  for (i = 0; i < numev; i++) {
+    now = pedal_evtime(&ev[i]);
+    detect_poll(&det);
+    detect_event(&det, now, ev[i].type, ev[i].code, ev[i].value);
+  }
+
+  detect_finish(&det);
+}
@@ -26,12 +26,24 @@
 #include <libgen.h>
 
 #include "footlog.h"
+#include "occupancy.h"
+#include "trace.h"
 
 
 int DebugFlag = 0; /* set by "-d" command line option */
 
 int GapSize = 1000;  /* default value is 1000 milliseconds; change via "-g"  */
 
+int RuntMax = RUNTMAX; /* change via "-r" */
+
+int DetectMode = DETECT_KEY; /* change via "-m" */
+
+/* Analog pedal thresholds; unless set, derived from device axis range */
+int AbsAxis = -1;  /* change via "-A" */
+int AbsHigh = 0;   /* change via "-H" */
+int AbsLow = 0;    /* change via "-L" */
+int AbsHighSet = 0, AbsLowSet = 0;
+
 
 /* File used for stdout an stderr of shell commands via "system"
    Removed at the end of successful execution.
@@ -47,6 +59,26 @@ char fpbus[BUFLEN], fpdevice[BUFLEN], fpid1[BUFLEN],
 char LogFileName[BUFLEN] = "/var/log/footlog/events.log"; /* can be changed by "-f" */
 FILE *LogFile = 0; /* pointer to log file after it is opened */
 
+/* Captured event stream to replay instead of listening to the pedal */
+char ReplayFileName[BUFLEN] = ""; /* empty means live; set by "-R" */
+char *GapList = 0, *RuntList = 0, *ModeList = 0; /* lists for replay */
+
+int CaptureFlag = 0; /* set by "-c" command line option */
+
+int OccupancyFlag = 0; /* set by "-o" command line option */
+char OccupancyFileName[BUFLEN] = "";
+int OccupancyFd = -1;
+
+/* File where decimated analog intensity samples are written */
+char IntensityFileName[BUFLEN] = ""; /* empty means disabled; set by "-i" */
+FILE *IntensityFile = 0;
+int IntensityMilli = 50; /* decimation interval; change via "-I" */
+
+/* File where rolling-window statistics are snapshotted */
+char StatsFileName[BUFLEN] = ""; /* empty means disabled; set by "-S" */
+char *StatsList = "60"; /* window lengths in seconds; change via "-w" */
+int StatsMilli = 1000; /* snapshot interval; change via "-P" */
+
 
 void parseargs (int argc, char **argv) 
 {
@@ -58,6 +90,16 @@ void parseargs (int argc, char **argv)
       continue;
     }
 
+    if (!strcmp(argv[i], "-c")) {
+      CaptureFlag = 1;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-o")) {
+      OccupancyFlag = 1;
+      continue;
+    }
+
     if (!strcmp(argv[i], "-t")) {
       if ((i+1) >= argc) goto ArgError;
 
@@ -71,24 +113,166 @@ void parseargs (int argc, char **argv)
       if ((i+1) >= argc) goto ArgError;
 
       GapSize  = atoi(argv[i+1]);
-      fprintf(stderr, "GapSize = %d\n", GapSize);
+      GapList = argv[i+1];
+      fprintf(stderr, "GapSize = %s\n", GapList);
       i++;
       continue;
     }
 
     if (!strcmp(argv[i], "-f")) {
       if ((i+1) >= argc) goto ArgError;
-      if (strlen(argv[i+1]) >= sizeof(LogFile)) goto ArgError; /* make sure we have enough space */
+      if (strlen(argv[i+1]) >= BUFLEN) goto ArgError; /* make sure we have enough space */
       sscanf(argv[i+1], "%s", LogFileName);
       fprintf(stderr, "LogFile is \"%s\"\n", LogFileName);
       i++;
       continue;
     }
 
+    if (!strcmp(argv[i], "-r")) {
+      if ((i+1) >= argc) goto ArgError;
+
+      RuntMax = atoi(argv[i+1]);
+      RuntList = argv[i+1];
+      fprintf(stderr, "RuntMax = %s\n", RuntList);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-m")) {
+      if ((i+1) >= argc) goto ArgError;
+      /* first mode is the live one; replay() checks the whole list */
+      if (!strncmp(argv[i+1], "key", 3)) DetectMode = DETECT_KEY;
+      else if (!strncmp(argv[i+1], "abs", 3)) DetectMode = DETECT_ABS;
+      else goto ArgError;
+      ModeList = argv[i+1];
+      fprintf(stderr, "DetectMode = %s\n", ModeList);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-A")) {
+      if ((i+1) >= argc) goto ArgError;
+      AbsAxis = atoi(argv[i+1]);
+      fprintf(stderr, "AbsAxis = %d\n", AbsAxis);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-H")) {
+      if ((i+1) >= argc) goto ArgError;
+      AbsHigh = atoi(argv[i+1]);
+      AbsHighSet = 1;
+      fprintf(stderr, "AbsHigh = %d\n", AbsHigh);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-L")) {
+      if ((i+1) >= argc) goto ArgError;
+      AbsLow = atoi(argv[i+1]);
+      AbsLowSet = 1;
+      fprintf(stderr, "AbsLow = %d\n", AbsLow);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-i")) {
+      if ((i+1) >= argc) goto ArgError;
+      if (strlen(argv[i+1]) >= BUFLEN) goto ArgError;
+      sscanf(argv[i+1], "%s", IntensityFileName);
+      fprintf(stderr, "IntensityFile is \"%s\"\n", IntensityFileName);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-I")) {
+      if ((i+1) >= argc) goto ArgError;
+      IntensityMilli = atoi(argv[i+1]);
+      if (IntensityMilli <= 0) goto ArgError;
+      fprintf(stderr, "IntensityMilli = %d\n", IntensityMilli);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-Q")) {
+      if ((i+1) >= argc) goto ArgError;
+      MarkerQlen = atoi(argv[i+1]);
+      if (MarkerQlen <= 0) goto ArgError;
+      fprintf(stderr, "MarkerQlen = %d\n", MarkerQlen);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-s")) {
+      if ((i+1) >= argc) goto ArgError;
+      if (strlen(argv[i+1]) >= BUFLEN) goto ArgError;
+      sscanf(argv[i+1], "%s", MarkerSocketName);
+      fprintf(stderr, "MarkerSocket is \"%s\"\n", MarkerSocketName);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-S")) {
+      if ((i+1) >= argc) goto ArgError;
+      if (strlen(argv[i+1]) >= BUFLEN) goto ArgError;
+      sscanf(argv[i+1], "%s", StatsFileName);
+      fprintf(stderr, "StatsFile is \"%s\"\n", StatsFileName);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-w")) {
+      if ((i+1) >= argc) goto ArgError;
+      StatsList = argv[i+1];
+      fprintf(stderr, "StatsWindows = %s\n", StatsList);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-P")) {
+      if ((i+1) >= argc) goto ArgError;
+      StatsMilli = atoi(argv[i+1]);
+      if (StatsMilli <= 0) goto ArgError;
+      fprintf(stderr, "StatsMilli = %d\n", StatsMilli);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-T")) {
+      if ((i+1) >= argc) goto ArgError;
+      if (strlen(argv[i+1]) >= BUFLEN) goto ArgError;
+      sscanf(argv[i+1], "%s", TraceFileName);
+      fprintf(stderr, "TraceFile is \"%s\"\n", TraceFileName);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-N")) {
+      if ((i+1) >= argc) goto ArgError;
+      TraceEntries = atol(argv[i+1]);
+      if (TraceEntries <= 0) goto ArgError;
+      fprintf(stderr, "TraceEntries = %ld\n", TraceEntries);
+      i++;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-R")) {
+      if ((i+1) >= argc) goto ArgError;
+      if (strlen(argv[i+1]) >= BUFLEN) goto ArgError;
+      sscanf(argv[i+1], "%s", ReplayFileName);
+      fprintf(stderr, "ReplayFile is \"%s\"\n", ReplayFileName);
+      i++;
+      continue;
+    }
 
     /* error exit */
     ArgError:
-    fprintf(stderr, "Usage: footlog [-d] [-t <milliseconds>]\n");
+    fprintf(stderr, "Usage: footlog [-d] [-c] [-o] [-t <milliseconds>] [-g <milliseconds>] [-f <logfile>]\n"
+	    "               [-r <milliseconds>] [-m key|abs] [-A <axis>] [-H <high>] [-L <low>]\n"
+	    "               [-i <intensityfile>] [-I <milliseconds>] [-s <markersocket>] [-Q <qlen>]\n"
+	    "               [-S <statsfile>] [-w <seconds>,...] [-P <milliseconds>]\n"
+	    "               [-T <tracefile>] [-N <entries>]\n"
+	    "       footlog -R <capturefile> [-g <ms>,...] [-r <ms>,...] [-m key|abs,...] [-f <logfile>]\n");
     exit(-1);
   }
 }
@@ -129,6 +313,69 @@ void exec_shellcmd (char *cmd)
   }
 }
 
+static char *sidecars[] = {".cap", ".occ"};
+
+static void ArchiveName(char *tfull, int size, const char *dn, time_t sec, int msec)
+/* Name in directory dn under which to save a log that starts at
+   sec.msec */
+{
+  char tbase[BUFLEN];
+  struct tm *tp;
+
+  tp = localtime(&sec);
+  strftime(tbase, sizeof(tbase)-1, "events-%Y-%m-%d-%H-%M-%S", tp);
+  if (DebugFlag)  fprintf(stderr, "tbase = \"%s\"\n", tbase);
+  snprintf(tfull, size-1, "%s/%s-%03d.log", dn, tbase, msec);
+  if (DebugFlag)  fprintf(stderr, "tfull = \"%s\"\n", tfull);
+}
+
+static void SaveSidecars(const char *tfull)
+/* Keep the capture and occupancy files, if any, paired with their
+   log, now saved as tfull */
+{
+  char sideold[BUFLEN], sidenew[BUFLEN];
+  unsigned i;
+  int rc;
+
+  for (i = 0; i < sizeof(sidecars)/sizeof(sidecars[0]); i++) {
+    sidecar_name(sideold, sizeof(sideold), LogFileName, sidecars[i]);
+    sidecar_name(sidenew, sizeof(sidenew), tfull, sidecars[i]);
+    rc = rename(sideold, sidenew);
+    if (rc < 0 && errno != ENOENT) {
+      perror(sideold);
+      exit(-1);
+    }
+    if (!rc && !strcmp(sidecars[i], ".cap")) capture_trim(sidenew);
+  }
+}
+
+static void SaveOrphanSidecars(const char *dn)
+/* The old log is missing or empty, so there is no timestamp to name
+   its sidecars by; a capture of nothing but runts is still worth
+   replaying.  Name them by the first record of the capture file, or
+   else by when a sidecar was last written */
+{
+  char side[BUFLEN], tfull[BUFLEN];
+  struct stat sb;
+  time_t sec;
+  unsigned i;
+  int msec;
+
+  sidecar_name(side, sizeof(side), LogFileName, ".cap");
+  if (capture_first(side, &sec, &msec) < 0) {
+    for (i = 0; i < sizeof(sidecars)/sizeof(sidecars[0]); i++) {
+      sidecar_name(side, sizeof(side), LogFileName, sidecars[i]);
+      if (!stat(side, &sb)) break;
+    }
+    if (i == sizeof(sidecars)/sizeof(sidecars[0])) return; /* none */
+    sec = sb.st_mtim.tv_sec;
+    msec = sb.st_mtim.tv_nsec / 1000000;
+  }
+  ArchiveName(tfull, sizeof(tfull), dn, sec, msec);
+  if (DebugFlag) fprintf(stderr, "Saving sidecars of %s as %s\n", LogFileName, tfull);
+  SaveSidecars(tfull);
+}
+
 void OpenWithSave()
 /* 
   Check if LogFileName already exists.  If it does, rename it to use
@@ -136,8 +383,7 @@ void OpenWithSave()
   pointer in LogFile.
 */
 { 
-  char oneline[BUFLEN], tfull[BUFLEN], tbase[BUFLEN], *lfn, *dn; 
-  struct tm *tp;
+  char oneline[BUFLEN], tfull[BUFLEN], *lfn, *dn; 
   time_t sec;  /** doesn't work if I use "int" */
   int msec, rc;
   struct stat sb;
@@ -149,7 +395,10 @@ void OpenWithSave()
   /* Check if LogFileName exists and obtain its first timestamp  */
   LogFile = fopen(LogFileName, "r");
   if (!LogFile) {
-    if (errno == ENOENT) goto CreateNewFile; /* OK, no such file exists */
+    if (errno == ENOENT) {/* OK, no such file exists */
+      SaveOrphanSidecars(dn);
+      goto CreateNewFile;
+    }
     perror(LogFileName); /* something more seriously wrong */
     exit(-1);
   }
@@ -169,6 +418,7 @@ void OpenWithSave()
       exit(-1);
     }
     if (DebugFlag) fprintf(stderr, "Deleted %s\n", LogFileName);
+    SaveOrphanSidecars(dn);
     goto CreateNewFile;
   }
 
@@ -187,11 +437,7 @@ void OpenWithSave()
   if (DebugFlag) fprintf(stderr, "LogFile Timestamp = %ld.%d\n", sec, msec);
   
   /* Construct filename of rename() target */
-  tp = localtime(&sec);
-  strftime(tbase, sizeof(tbase)-1, "events-%Y-%m-%d-%H-%M-%S", tp);
-  if (DebugFlag)  fprintf(stderr, "tbase = \"%s\"\n", tbase);
-  snprintf(tfull, sizeof(tfull)-1, "%s/%s-%03d.log", dn, tbase, msec);
-  if (DebugFlag)  fprintf(stderr, "tfull = \"%s\"\n", tfull);
+  ArchiveName(tfull, sizeof(tfull), dn, sec, msec);
 
 
   rc =  rename(LogFileName, tfull);
@@ -199,6 +445,8 @@ void OpenWithSave()
     perror(LogFileName);
     exit(-1);
   }
+  SaveSidecars(tfull);
+
   /* Old LogFile has been saved under new name; now open the fresh file */
 
  CreateNewFile:
@@ -225,18 +473,48 @@ int main(int argc, char **argv)
 {
   int rc;
 
+  /* Process command line args */
+  parseargs(argc, argv);
+
+  /* Replay needs neither the pedal nor root privileges */
+  if (ReplayFileName[0]) exit(replay());
+
+  if ((GapList && strchr(GapList, ',')) || (RuntList && strchr(RuntList, ','))
+      || (ModeList && strchr(ModeList, ','))) {
+    fprintf(stderr, "ERROR: lists of values are only allowed with -R\n");
+    exit(-1);
+  }
+
   if (getuid() != 0) {
     fprintf(stderr, "ERROR: footlog has to be run  as root\n");
     exit(-1);
   }
-
-  /* Process command line args */
-  parseargs(argc, argv);
   mktempfile();  /* Available for reuse until exit */
 
   /* Open the log file */
   OpenWithSave();
 
+  /* Start the occupancy sidecar afresh, like the log */
+  if (OccupancyFlag) {
+    sidecar_name(OccupancyFileName, BUFLEN, LogFileName, ".occ");
+    OccupancyFd = occ_create(OccupancyFileName);
+    if (OccupancyFd < 0) {
+      perror(OccupancyFileName);
+      exit(-1);
+    }
+  }
+
+  /* Open the optional intensity stream; large buffer so that
+     high-rate analog pedals do not cost a write() per sample */
+  if (IntensityFileName[0]) {
+    IntensityFile = fopen(IntensityFileName, "w");
+    if (!IntensityFile) {
+      perror(IntensityFileName);
+      exit(-1);
+    }
+    setvbuf(IntensityFile, NULL, _IOFBF, 1 << 16);
+  }
+
   /* Find the foot pedal among USB devices */
   rc = usbstuff_discover();
   if (rc < 0) {
@@ -253,8 +531,15 @@ int main(int argc, char **argv)
   if (DebugFlag) fprintf(stderr, "xinput devices disabled = %d\n", rc);
 
   /* Discover event devices corresponding to the foot pedal */
+  if (CaptureFlag) sidecar_name(CaptureFileName, BUFLEN, LogFileName, ".cap");
   scan_devices();
 
+  /* Trace the listening loop from here on */
+  if (TraceFileName[0]) trace_open(TraceFileName, TraceEntries);
+
+  /* Accept markers from other programs */
+  if (MarkerSocketName[0]) marker_open();
+
   /* Listen for events on devices */
   logevents();
 
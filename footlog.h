@@ -10,6 +10,11 @@
 #include <config.h>
 #endif
 
+#include <stdint.h>
+#include <time.h>
+
+#include "detect.h"
+
 extern int DebugFlag;
 
 /* Minimum gap size in milliseconds between occurrences of the
@@ -19,6 +24,94 @@ extern int DebugFlag;
 */
 extern int GapSize;  /* can be changed by "-g <value>" on command line */
 
+/* Sequences no longer than RuntMax milliseconds are runts and are not
+   logged.  Can be changed by "-r <value>" on command line */
+#define RUNTMAX 10  /* default */
+extern int RuntMax;
+
+/* Detection mode, DETECT_KEY or DETECT_ABS (see detect.h).
+   Changed by "-m key" or "-m abs" on command line */
+extern int DetectMode;
+
+/* Hysteresis thresholds for DETECT_ABS, in raw axis units.  A press
+   starts when the axis reaches AbsHigh and ends when it falls to
+   AbsLow or below.  Either may be negative; those not set on the
+   command line (AbsHighSet, AbsLowSet) are derived from the axis
+   range reported by the device.  AbsAxis selects the axis (ABS_*
+   code); -1 means the first axis the device reports, which is then
+   stored here, so that only that axis feeds the hysteresis. */
+extern int AbsAxis, AbsHigh, AbsLow;
+extern int AbsHighSet, AbsLowSet;
+
+/* Optional decimated stream of analog intensity samples: at most one
+   line per IntensityMilli milliseconds, holding the peak value seen
+   in that interval.  Disabled unless "-i <file>" is given */
+extern char IntensityFileName[];
+extern FILE *IntensityFile;
+extern int IntensityMilli;
+
+/* Offline replay of a captured event stream ("-R <file>").  In replay
+   mode, "-g", "-r" and "-m" accept comma-separated lists, and every
+   combination is replayed in parallel into its own log file.  The
+   lists are kept as given on the command line; null if not given */
+extern char ReplayFileName[];
+extern char *GapList, *RuntList, *ModeList;
+
+/* Raw capture of every input event, written next to the log file
+   when "-c" is given: "events.log" is accompanied by "events.cap".
+   The file is a capheader followed by one caprec per event.  The
+   index of the device the event came from shares a word with the
+   microseconds, which never need more than CAPDEVSHIFT bits */
+#define CAPMAGIC "FOOTCAP1"
+#define CAPDEVSHIFT 20
+#define CAPUSEC(r) ((r)->usec_dev & ((1 << CAPDEVSHIFT) - 1))
+#define CAPDEV(r) ((r)->usec_dev >> CAPDEVSHIFT)
+
+struct capheader {
+  char magic[8];
+  uint32_t recsize; /* sizeof(struct caprec) */
+  uint32_t ndev;    /* number of devices captured */
+};
+
+struct caprec {
+  uint32_t sec;
+  uint32_t usec_dev; /* device index << CAPDEVSHIFT | microseconds */
+  uint16_t type;
+  uint16_t code;
+  int32_t value;
+};
+
+extern int CaptureFlag;
+extern char CaptureFileName[];
+
+/* Marker channel: UNIX datagram socket on which other programs can
+   send text markers ("-s <path>"); see footmark.h for the client side.
+   Markers are logged as "sec.msec: MARK <text>" lines, in time order
+   with the DOWN and UP lines */
+extern char MarkerSocketName[];
+extern int MarkerFd;
+
+/* "-Q <n>": raise the system-wide net.unix.max_dgram_qlen to at least
+   n before creating the marker socket, for bursts of markers.  Off by
+   default; the setting is not restored at exit */
+extern int MarkerQlen;
+
+/* Occupancy sidecar ("-o"): one record per press, next to the log;
+   see occupancy.h */
+extern int OccupancyFlag;
+extern char OccupancyFileName[];
+extern int OccupancyFd;
+
+/* Binary trace ring ("-T <file>", "-N <entries>"); see trace.h */
+extern char TraceFileName[];
+extern long TraceEntries;
+
+/* Rolling-window statistics snapshot ("-S <path>"), rewritten every
+   StatsMilli milliseconds for windows of StatsList seconds */
+extern char StatsFileName[];
+extern char *StatsList;
+extern int StatsMilli;
+
 /* Length of buffers used as globals for device information */
 #define BUFLEN 1000   /* way too much, but playing it safe */
 
@@ -44,3 +137,14 @@ extern int usbstuff_discover();
 extern int usbstuff_disable();
 extern void scan_devices();
 extern void logevents();
+extern void replay_events(struct input_event *, long);
+extern void capture_open(int, int);
+extern void capture_event(int, struct input_event *);
+extern void capture_flush();
+extern void capture_close();
+extern void capture_trim(const char *);
+extern int capture_first(const char *, time_t *, int *);
+extern void marker_open();
+extern int marker_recv();
+extern void marker_deliver(detector_t *, mstime_t);
+extern int replay();
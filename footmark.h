@@ -0,0 +1,57 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Client side of the footlog marker channel ("footlog -s <socket>").
+   Include this in stimulus software:
+
+     int fd = footmark_open("/run/footlog.sock");
+     ...
+     footmark_send(fd, "condition A started");
+
+   footmark_send() is a single non-blocking send() on a connected
+   datagram socket.  It never waits for footlog: if footlog is not
+   keeping up, the marker is dropped and -1 is returned with errno set
+   to EAGAIN.  The marker is timestamped by the kernel when it arrives,
+   so the caller need not supply a time.  Text longer than MARKLEN (see
+   detect.h) is truncated; a trailing newline is ignored. */
+
+#ifndef FOOTMARK_H
+#define FOOTMARK_H
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static inline int footmark_open(const char *path)
+/* Returns a socket connected to footlog's marker socket, or -1 */
+{
+  struct sockaddr_un sa;
+  int fd;
+
+  if (strlen(path) >= sizeof(sa.sun_path)) return(-1);
+  fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return(-1);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, path);
+  if (connect(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+    close(fd);
+    return(-1);
+  }
+  return(fd);
+}
+
+static inline int footmark_send(int fd, const char *text)
+/* Send one marker; returns 0 on success, -1 if it was not sent */
+{
+  return(send(fd, text, strlen(text), MSG_DONTWAIT | MSG_NOSIGNAL) < 0 ? -1 : 0);
+}
+
+#endif /* FOOTMARK_H */
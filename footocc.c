@@ -0,0 +1,237 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* footocc: occupancy queries against a footlog session.
+
+     footocc -b events.log [events.occ]
+       builds the occupancy sidecar of an existing log from its UP lines
+     footocc events.occ|events.log < queries
+       answers queries, one per line of input, in the same order:
+         "t"      ->  1 if the pedal was down at time t, else 0
+         "t1 t2"  ->  milliseconds the pedal was down in [t1, t2)
+
+   Times are seconds since the epoch with up to 3 decimals, as in the
+   log.  All queries are read before any is answered, so that they go
+   through the batched lookups of occupancy.c. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "occupancy.h"
+
+static void usage()
+{
+  fprintf(stderr, "Usage: footocc -b <logfile> [<occfile>]\n"
+	  "       footocc <occfile>|<logfile> < queries\n");
+  exit(-1);
+}
+
+static int parse_time(char **s, mstime_t *t)
+/* Parse "sec[.frac]" at *s into milliseconds, advancing *s past it.
+   Returns 1 if there was a time, 0 if not */
+{
+  char *p = *s;
+  mstime_t ms = 0;
+  int neg = 0, scale;
+
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p == '-') {
+    neg = 1;
+    p++;
+  }
+  if (*p < '0' || *p > '9') return(0);
+  while (*p >= '0' && *p <= '9') ms = ms*10 + (*p++ - '0');
+  ms *= 1000;
+  if (*p == '.') {
+    p++;
+    for (scale = 100; *p >= '0' && *p <= '9'; p++) {
+      ms += (*p - '0') * scale;
+      scale /= 10;
+    }
+  }
+  *t = neg ? -ms : ms;
+  *s = p;
+  return(1);
+}
+
+static long log_runs(const char *path, struct occrec **runs)
+/* Collect the presses in the UP lines of a log into *runs (malloc'd);
+   returns how many.  An UP line carries LastOne and seqlen, so its
+   DOWN line is not needed */
+{
+  char oneline[1000], *p;
+  struct occrec *r = 0, *nr;
+  long n = 0, cap = 0;
+  mstime_t up;
+  int seqlen;
+  FILE *f;
+
+  f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    exit(-1);
+  }
+  while (fgets(oneline, sizeof(oneline), f)) {
+    p = oneline;
+    if (!parse_time(&p, &up) || strncmp(p, ": UP ", 5)) continue;
+    p = strstr(p, "seqlen = ");
+    if (!p || sscanf(p, "seqlen = %d", &seqlen) != 1) continue;
+
+    if (n == cap) {
+      cap = cap ? 2*cap : 1024;
+      nr = realloc(r, cap * sizeof(*r));
+      if (!nr) {
+	perror("realloc");
+	exit(-1);
+      }
+      r = nr;
+    }
+    r[n].start = up - seqlen;
+    r[n].end = up;
+    n++;
+  }
+  fclose(f);
+  *runs = r;
+  return(n);
+}
+
+static int is_log(const char *path)
+/* Is path a log (text), as opposed to a sidecar? */
+{
+  FILE *f;
+  char magic[8];
+  int rc;
+
+  f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    exit(-1);
+  }
+  rc = fread(magic, 1, sizeof(magic), f) != sizeof(magic)
+    || memcmp(magic, OCCMAGIC, sizeof(magic));
+  fclose(f);
+  return(rc);
+}
+
+static void build(char *logname, char *occname)
+/* footocc -b: write the sidecar of logname */
+{
+  char derived[1000];
+  struct occrec *r;
+  long n, i;
+  int fd;
+
+  if (!occname) {
+    sidecar_name(derived, sizeof(derived), logname, ".occ");
+    occname = derived;
+  }
+
+  n = log_runs(logname, &r);
+  fd = occ_create(occname);
+  if (fd < 0) {
+    perror(occname);
+    exit(-1);
+  }
+  for (i = 0; i < n; i++) {
+    if (occ_append(fd, r[i].start, r[i].end) < 0) {
+      perror(occname);
+      exit(-1);
+    }
+  }
+  close(fd);
+  free(r);
+  fprintf(stderr, "%s: %ld presses\n", occname, n);
+}
+
+static void query(char *path)
+/* footocc <file> < queries */
+{
+  char oneline[1000], *p;
+  occindex_t x;
+  struct occrec *r;
+  mstime_t *t1 = 0, *t2 = 0, *down;
+  unsigned char *isdown, *range = 0;
+  long n = 0, cap = 0, i, nr;
+  int rc;
+
+  if (is_log(path)) {
+    nr = log_runs(path, &r);
+    rc = occ_build(&x, r, nr);
+    free(r);
+  }
+  else rc = occ_load(&x, path);
+  if (rc < 0) {
+    perror(path);
+    exit(-1);
+  }
+
+  while (fgets(oneline, sizeof(oneline), stdin)) {
+    if (n == cap) {
+      cap = cap ? 2*cap : 4096;
+      t1 = realloc(t1, cap * sizeof(*t1));
+      t2 = realloc(t2, cap * sizeof(*t2));
+      range = realloc(range, cap);
+      if (!t1 || !t2 || !range) {
+	perror("realloc");
+	exit(-1);
+      }
+    }
+    p = oneline;
+    if (!parse_time(&p, &t1[n])) {
+      fprintf(stderr, "Can't understand query %ld: %s", n + 1, oneline);
+      exit(-1);
+    }
+    range[n] = parse_time(&p, &t2[n]);
+    if (!range[n]) t2[n] = t1[n];
+    else if (t2[n] < t1[n]) {
+      fprintf(stderr, "Query %ld ends before it starts: %s", n + 1, oneline);
+      exit(-1);
+    }
+    n++;
+  }
+
+  isdown = malloc(n ? n : 1);
+  down = malloc((n ? n : 1) * sizeof(*down));
+  if (!isdown || !down) {
+    perror("malloc");
+    exit(-1);
+  }
+  occ_isdown(&x, t1, n, isdown);
+  occ_downtime(&x, t1, t2, n, down);
+
+  for (i = 0; i < n; i++) {
+    if (range[i]) printf("%lld\n", (long long) down[i]);
+    else printf("%d\n", isdown[i]);
+  }
+
+  free(t1);
+  free(t2);
+  free(range);
+  free(isdown);
+  free(down);
+  occ_free(&x);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc >= 3 && !strcmp(argv[1], "-b")) {
+    if (argc > 4) usage();
+    build(argv[2], argc == 4 ? argv[3] : 0);
+    return(0);
+  }
+  if (argc != 2 || argv[1][0] == '-') usage();
+  query(argv[1]);
+  return(0);
+}
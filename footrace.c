@@ -0,0 +1,120 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* footrace: decode a trace ring written by "footlog -T <file>".
+
+     footrace <tracefile>
+
+   One line per entry, oldest first: wall-clock time, microseconds
+   since the previous entry, and what happened. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "detect.h"
+#include "trace.h"
+
+static const char *kindname[] = {
+  "?", "wakeup", "read", "event", "gap", "start", "end", "markers", "sleep", "dump"
+};
+
+static void print_ms(int64_t ms)
+/* An absolute time in ms, in the log's seconds.milliseconds form */
+{
+  printf("%" PRId64 ".%03" PRId64, ms/1000, ms%1000);
+}
+
+static void print_entry(const struct traceent *e)
+/* The fields of one entry, after its time and kind */
+{
+  switch (e->kind) {
+  case TR_WAKEUP:
+    printf("rc = %d  timeout = %" PRId64 " ms", e->a, e->b);
+    break;
+  case TR_READ:
+    printf("dev %d  %d bytes", e->dev, e->a);
+    break;
+  case TR_EVENT:
+    printf("dev %d  %" PRId64 ".%06" PRId64 "  type %d  code %d  value %" PRId64,
+	   e->dev, e->c/1000000, e->c%1000000, (e->a >> 16) & 0xffff, e->a & 0xffff, e->b);
+    break;
+  case TR_GAP:
+    printf("dev %d  gap = %d ms%s", e->dev, e->a, e->b ? "  ends sequence" : "");
+    break;
+  case TR_START:
+    printf("dev %d  FirstOne = ", e->dev);
+    print_ms(e->b);
+    break;
+  case TR_END:
+    printf("%s  seqlen = %d ms  LastOne = ", e->c == REC_RUNT ? "runt" : "up", e->a);
+    print_ms(e->b);
+    break;
+  case TR_MARKERS:
+    printf("%d received", e->a);
+    break;
+  case TR_SLEEP:
+    printf("%d ms", e->a);
+    break;
+  case TR_DUMP:
+    if (e->a) printf("on signal %d", e->a);
+    else printf("at exit");
+    break;
+  default:
+    printf("a = %d  b = %" PRId64 "  c = %" PRId64, e->a, e->b, e->c);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  struct traceheader hdr;
+  struct traceent e;
+  int64_t prev = 0, wall;
+  uint32_t i;
+  FILE *f;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: footrace <tracefile>\n");
+    exit(-1);
+  }
+  if (!(f = fopen(argv[1], "r"))) {
+    perror(argv[1]);
+    exit(-1);
+  }
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, TRACEMAGIC, sizeof(hdr.magic))) {
+    fprintf(stderr, "%s: not a footlog trace\n", argv[1]);
+    exit(-1);
+  }
+  if (hdr.entsize != sizeof(struct traceent)) {
+    fprintf(stderr, "%s: entries are %u bytes, expected %u\n", argv[1],
+	    hdr.entsize, (unsigned) sizeof(struct traceent));
+    exit(-1);
+  }
+  printf("%u entries (%" PRIu64 " recorded in all)\n", hdr.nent, hdr.total);
+
+  for (i = 0; i < hdr.nent; i++) {
+    if (fread(&e, sizeof(e), 1, f) != 1) {
+      fprintf(stderr, "%s: truncated after %u entries\n", argv[1], i);
+      exit(-1);
+    }
+    wall = e.ns + hdr.realoffset;
+    printf("%" PRId64 ".%06" PRId64 "  %+8" PRId64 "  %-7s  ",
+	   wall/1000000000, (wall%1000000000)/1000, i ? (e.ns - prev)/1000 : 0,
+	   e.kind < sizeof(kindname)/sizeof(kindname[0]) ? kindname[e.kind] : "?");
+    print_entry(&e);
+    printf("\n");
+    prev = e.ns;
+  }
+  fclose(f);
+  return(0);
+}
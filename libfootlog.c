@@ -0,0 +1,312 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* libfootlog: discovery, grab and detection of footlog, packaged for
+   use inside an application (see libfootlog.h).  Discovery, the
+   timestamp merge and the detector are the daemon's own (pedal.c,
+   detect.c); everything the daemon keeps in globals (evdevfd[],
+   LogFile, ...) lives in the context here, and nothing exits or
+   prints: errors are returned with errno set. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+
+#include "detect.h"
+#include "pedal.h"
+#include "libfootlog.h"
+
+struct footlog {
+  footlog_config_t cf;
+  char device[256];   /* cf.device points here if it was given */
+
+  int ndev;
+  int fd[PEDALDEVMAX];
+  int epfd;           /* readable when any of fd[] is */
+
+  detector_t det;
+  pedalmerge_t merge;
+
+  footlog_callback_t cb;
+  void *cbarg;
+  int delivered;      /* records delivered by this footlog_process() */
+
+  /* Records for footlog_next() when there is no callback: a FIFO in
+     q[qhead..nq-1], grown as needed */
+  footlog_rec_t *q;
+  int qhead, nq, qcap;
+};
+
+
+void footlog_defaults(footlog_config_t *cf)
+/* Fill cf with the daemon's defaults */
+{
+  memset(cf, 0, sizeof(*cf));
+  cf->usbmatch = PEDALUSBMATCH;
+  cf->grab = 1;
+  cf->mode = FOOTLOG_KEY;
+  cf->gapsize = 1000;
+  cf->runtmax = 10;
+  cf->absaxis = -1;
+}
+
+
+static void deliver(footlog_t *fl, const footlog_rec_t *r)
+/* Pass r to the callback, or queue it for footlog_next() */
+{
+  footlog_rec_t *q;
+
+  fl->delivered++;
+  if (fl->cb) {
+    fl->cb(fl->cbarg, r);
+    return;
+  }
+
+  if (fl->nq == fl->qcap) {
+    if (fl->qhead) {/* reclaim space of records already taken */
+      memmove(fl->q, fl->q + fl->qhead, (fl->nq - fl->qhead) * sizeof(*q));
+      fl->nq -= fl->qhead;
+      fl->qhead = 0;
+    }
+    else {
+      q = realloc(fl->q, (fl->qcap ? 2*fl->qcap : 16) * sizeof(*q));
+      if (!q) return; /* out of memory; the record is lost */
+      fl->q = q;
+      fl->qcap = fl->qcap ? 2*fl->qcap : 16;
+    }
+  }
+  fl->q[fl->nq++] = *r;
+}
+
+static void lib_sink(void *arg, const detrec_t *rec)
+/* Detector sink: translate detector records for the application */
+{
+  footlog_t *fl = arg;
+  const seq_t *cs = rec->seq;
+  footlog_rec_t r;
+
+  if (rec->kind == REC_RUNT) return;
+
+  memset(&r, 0, sizeof(r));
+  r.kind = rec->kind;
+  r.time = rec->time;
+  switch (rec->kind) {
+  case REC_DOWN:
+    r.heldstart = cs->heldstart;
+    break;
+
+  case REC_UP:
+    r.seqlen = rec->seqlen;
+    r.gap = rec->gap;
+    r.key1count = cs->key1count;
+    if (cs->abscount) {
+      r.absmin = cs->absmin;
+      r.absmax = cs->absmax;
+      r.absmean = cs->absspan ? cs->absintegral/cs->absspan
+	: (double) cs->abssum/cs->abscount;
+    }
+    break;
+
+  case REC_INTENSITY:
+    r.value = rec->value;
+    break;
+
+  case REC_MARKER:
+    memcpy(r.text, rec->text, rec->len);
+    break;
+  }
+  deliver(fl, &r);
+}
+
+footlog_t *footlog_open(const footlog_config_t *cf, footlog_callback_t cb, void *arg)
+/* Create a context with configuration cf.  Records go to cb, or are
+   queued for footlog_next() if cb is null.  Returns null with errno
+   set on failure: ENODEV if there is no pedal, EBUSY if it is already
+   grabbed */
+{
+  char path[PEDALDEVMAX][PEDALPATHLEN];
+  pedalusb_t u;
+  struct epoll_event ev;
+  detparams_t p;
+  footlog_t *fl;
+  int i, n, saved;
+
+  fl = calloc(1, sizeof(*fl));
+  if (!fl) return(0);
+  fl->cf = *cf;
+  if (!fl->cf.usbmatch) fl->cf.usbmatch = PEDALUSBMATCH;
+  if (!fl->cf.clock) fl->cf.clock = pedal_clock;
+  fl->cb = cb;
+  fl->cbarg = arg;
+  fl->epfd = -1;
+
+  if (cf->device) {
+    if (strlen(cf->device) >= sizeof(fl->device)) {
+      errno = ENAMETOOLONG;
+      goto ErrorExit;
+    }
+    strcpy(fl->device, cf->device);
+    fl->cf.device = fl->device;
+    strcpy(path[0], fl->device);
+    n = 1;
+  }
+  else {
+    if (pedal_discover(fl->cf.usbmatch, &u) < 0) goto ErrorExit;
+    if ((n = pedal_find_devices(u.id1, u.id2, path, PEDALDEVMAX)) < 0) goto ErrorExit;
+  }
+
+  fl->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (fl->epfd < 0) goto ErrorExit;
+
+  for (i = 0; i < n; i++) {
+    fl->fd[i] = open(path[i], O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fl->fd[i] < 0) goto ErrorExit;
+    fl->ndev++;
+    fl->merge.ndev = fl->ndev;
+    if (fl->cf.grab && ioctl(fl->fd[i], EVIOCGRAB, (void *)1) < 0) {
+      errno = EBUSY;
+      goto ErrorExit;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    if (epoll_ctl(fl->epfd, EPOLL_CTL_ADD, fl->fd[i], &ev) < 0) goto ErrorExit;
+  }
+
+  if (fl->cf.mode == FOOTLOG_ABS) {
+    if (pedal_abs_thresholds(fl->fd, fl->ndev, &fl->cf.absaxis, &fl->cf.abshigh,
+			     &fl->cf.abslow, fl->cf.abshighset, fl->cf.abslowset) < 0)
+      goto ErrorExit;
+    if (fl->cf.abslow >= fl->cf.abshigh) {
+      errno = EINVAL;
+      goto ErrorExit;
+    }
+  }
+
+  p.gapsize = fl->cf.gapsize;
+  p.runtmax = fl->cf.runtmax;
+  p.mode = fl->cf.mode;
+  p.absaxis = fl->cf.absaxis;
+  p.abshigh = fl->cf.abshigh;
+  p.abslow = fl->cf.abslow;
+  p.intensitymilli = fl->cf.intensitymilli;
+  detect_init(&fl->det, &p, lib_sink, fl, fl->cf.clock, fl->cf.clockarg);
+  return(fl);
+
+ ErrorExit:
+  saved = errno;
+  footlog_close(fl);
+  errno = saved;
+  return(0);
+}
+
+
+int footlog_fd(footlog_t *fl)
+/* A file descriptor that polls readable when there is input */
+{
+  return(fl->epfd);
+}
+
+int footlog_timeout(footlog_t *fl)
+/* Milliseconds until footlog_process() must be called even without
+   input, to end a press on time; -1 if there is no such deadline */
+{
+  mstime_t deadline, wait;
+
+  deadline = detect_deadline(&fl->det);
+  if (deadline < 0) return(-1);
+  wait = deadline - fl->det.clock(fl->det.clockarg);
+  return(wait < 0 ? 0 : (int) wait);
+}
+
+
+int footlog_process(footlog_t *fl)
+/* Read whatever input is pending without blocking, and run it and the
+   clock through the detector.  Returns the number of records
+   delivered, or -1 with errno set (ENODEV if the pedal was unplugged) */
+{
+  struct input_event *e;
+  int j, rd, full;
+
+  fl->delivered = 0;
+  do {
+    full = 0;
+    for (j = 0; j < fl->ndev; j++) {
+      fl->merge.count[j] = 0;
+      fl->merge.head[j] = 0;
+      rd = read(fl->fd[j], fl->merge.buf[j], sizeof(fl->merge.buf[j]));
+      if (rd < 0) {
+	if (errno == EAGAIN || errno == EINTR) continue;
+	return(-1);
+      }
+      fl->merge.count[j] = rd / sizeof(struct input_event);
+      if (fl->merge.count[j] == PEDALBATCH) full = 1;
+    }
+
+    while ((e = pedal_merge_next(&fl->merge, &j)))
+      detect_event(&fl->det, pedal_evtime(e), e->type, e->code, e->value);
+  } while (full); /* more may be waiting */
+
+  detect_poll(&fl->det);
+  return(fl->delivered);
+}
+
+int footlog_wait(footlog_t *fl, int timeout)
+/* Wait up to timeout milliseconds (-1 for ever) for input, or less if
+   a press is due to end, then process it.  Returns as
+   footlog_process(); 0 if interrupted by a signal */
+{
+  struct epoll_event ev;
+  int t;
+
+  t = footlog_timeout(fl);
+  if (t < 0 || (timeout >= 0 && timeout < t)) t = timeout;
+  if (epoll_wait(fl->epfd, &ev, 1, t) < 0) return(errno == EINTR ? 0 : -1);
+  return(footlog_process(fl));
+}
+
+int footlog_next(footlog_t *fl, footlog_rec_t *r)
+/* Take the oldest queued record into r.  Returns 1 if there was one,
+   0 if not */
+{
+  if (fl->qhead >= fl->nq) return(0);
+  *r = fl->q[fl->qhead++];
+  if (fl->qhead == fl->nq) fl->qhead = fl->nq = 0;
+  return(1);
+}
+
+void footlog_marker(footlog_t *fl, const char *text)
+/* Put a marker with the given text into the record stream now, in
+   time order with the DOWN and UP records */
+{
+  detect_marker(&fl->det, fl->det.clock(fl->det.clockarg), text, strlen(text));
+}
+
+void footlog_close(footlog_t *fl)
+/* Release the devices and everything else held by fl */
+{
+  int i;
+
+  if (!fl) return;
+  for (i = 0; i < fl->ndev; i++) close(fl->fd[i]); /* ends any grab */
+  if (fl->epfd >= 0) close(fl->epfd);
+  detect_free(&fl->det);
+  free(fl->q);
+  free(fl);
+}
@@ -0,0 +1,108 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* libfootlog: foot pedal detection inside an application, without the
+   footlog daemon.  Link with -lfootlog.  A context finds the pedal
+   (or opens the device given), optionally grabs it, and runs the same
+   sequence detector as footlog on its events.  DOWN and UP records
+   reach the application through a callback, or are queued for
+   footlog_next() if no callback is given.  There is no global state,
+   so several contexts can coexist; only one of them can grab a given
+   pedal, though.
+
+     footlog_config_t cf;
+     footlog_t *fl;
+     footlog_rec_t r;
+
+     footlog_defaults(&cf);
+     fl = footlog_open(&cf, 0, 0);
+     for (;;) {
+       footlog_wait(fl, -1);
+       while (footlog_next(fl, &r)) ...;
+     }
+
+   An application with its own event loop instead watches footlog_fd()
+   for input, wakes up after footlog_timeout() milliseconds at the
+   latest, and calls footlog_process() in either case.
+
+   Opening the event devices usually needs root or membership of the
+   "input" group.  Unlike the daemon, the library does not disable the
+   pedal in X windows; a grab keeps its events from everyone else. */
+
+#ifndef LIBFOOTLOG_H
+#define LIBFOOTLOG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FOOTLOG_API __attribute__((visibility("default")))
+
+/* Record kinds; the same values as REC_* in detect.h */
+#define FOOTLOG_DOWN 1       /* start of a press */
+#define FOOTLOG_UP 2         /* end of a press */
+#define FOOTLOG_INTENSITY 4  /* peak analog value over one interval */
+#define FOOTLOG_MARKER 5     /* text given to footlog_marker() */
+
+#define FOOTLOG_KEY 0        /* digital pedal: stream of KEY_1 */
+#define FOOTLOG_ABS 1        /* analog pedal: EV_ABS axis */
+
+#define FOOTLOG_TEXTLEN 120  /* marker text; longer is truncated */
+
+typedef struct footlog_config {
+  const char *device;  /* event device to open; 0 to discover */
+  const char *usbmatch; /* lsusb description to discover by */
+  int grab;            /* take the device for ourselves */
+  int mode;            /* FOOTLOG_KEY or FOOTLOG_ABS */
+  int gapsize;         /* ms without KEY_1 that end a press */
+  int runtmax;         /* presses no longer than this are ignored */
+  int absaxis;         /* FOOTLOG_ABS: axis code; -1 for the first one */
+  int abshigh, abslow; /* FOOTLOG_ABS: thresholds, in raw axis units */
+  int abshighset, abslowset; /* nonzero if abshigh, abslow are given;
+				otherwise 30% and 15% of the range */
+  int intensitymilli;  /* FOOTLOG_INTENSITY interval; 0 for none */
+  int64_t (*clock)(void *); /* current time in ms since the epoch, in
+			       the domain of the event timestamps; 0
+			       for CLOCK_REALTIME, as evdev uses */
+  void *clockarg;      /* passed to clock */
+} footlog_config_t;
+
+typedef struct footlog_rec {
+  int kind;         /* FOOTLOG_* */
+  int64_t time;     /* milliseconds since the epoch */
+  int seqlen;       /* FOOTLOG_UP: length of the press in ms */
+  int gap;          /* FOOTLOG_UP: ms of silence that ended it */
+  int key1count;    /* FOOTLOG_UP: KEY_1 events in the press */
+  int heldstart;    /* FOOTLOG_DOWN: pedal was down when opened */
+  int absmin, absmax; /* FOOTLOG_UP, analog pedals: pressure range */
+  double absmean;   /* FOOTLOG_UP, analog pedals: time-weighted mean */
+  int value;        /* FOOTLOG_INTENSITY */
+  char text[FOOTLOG_TEXTLEN + 1]; /* FOOTLOG_MARKER, null-terminated */
+} footlog_rec_t;
+
+typedef struct footlog footlog_t; /* opaque */
+
+typedef void (*footlog_callback_t)(void *arg, const footlog_rec_t *rec);
+
+FOOTLOG_API void footlog_defaults(footlog_config_t *);
+FOOTLOG_API footlog_t *footlog_open(const footlog_config_t *, footlog_callback_t, void *);
+FOOTLOG_API int footlog_fd(footlog_t *);
+FOOTLOG_API int footlog_timeout(footlog_t *);
+FOOTLOG_API int footlog_process(footlog_t *);
+FOOTLOG_API int footlog_wait(footlog_t *, int);
+FOOTLOG_API int footlog_next(footlog_t *, footlog_rec_t *);
+FOOTLOG_API void footlog_marker(footlog_t *, const char *);
+FOOTLOG_API void footlog_close(footlog_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBFOOTLOG_H */
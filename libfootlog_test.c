@@ -0,0 +1,180 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Tests for libfootlog.so.  Run by "make test".  No pedal is needed:
+   each context is given a FIFO as its device (without a grab), and
+   the test writes input events into it.  The contexts run on a clock
+   under the control of the test, so timing does not depend on how
+   busy the machine is. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <linux/input.h>
+
+#include "libfootlog.h"
+#include "check.h"
+
+#define T0 1600000000000LL /* some time in ms, when the tests start */
+
+/* Clock under the control of the test */
+static int64_t now = T0;
+
+static int64_t fake_clock(void *arg)
+{
+  return(*(int64_t *) arg);
+}
+
+static void press(int fd, int64_t from, int64_t to)
+/* Write a digital press from..to into fd: KEY_1 every 33 ms */
+{
+  struct input_event e[2];
+  int64_t t;
+
+  for (t = from; t <= to; t += 33) {
+    memset(e, 0, sizeof(e));
+    e[0].time.tv_sec = t / 1000;
+    e[0].time.tv_usec = (t % 1000) * 1000;
+    e[0].type = EV_KEY;
+    e[0].code = KEY_1;
+    e[0].value = t == from ? 1 : 2;
+    e[1].time = e[0].time;
+    e[1].type = EV_SYN;
+    if (write(fd, e, sizeof(e)) != sizeof(e)) perror("write");
+  }
+}
+
+static footlog_t *open_fifo(const char *path, int *wfd, footlog_callback_t cb, void *arg)
+/* Context reading from a new FIFO at path; *wfd is its write end */
+{
+  footlog_config_t cf;
+  footlog_t *fl;
+
+  unlink(path);
+  if (mkfifo(path, 0600) < 0) {
+    perror(path);
+    exit(1);
+  }
+  footlog_defaults(&cf);
+  cf.device = path;
+  cf.grab = 0;
+  cf.gapsize = 200;
+  cf.clock = fake_clock;
+  cf.clockarg = &now;
+  fl = footlog_open(&cf, cb, arg);
+  *wfd = open(path, O_WRONLY);
+  return(fl);
+}
+
+typedef struct collector {
+  int n;
+  footlog_rec_t rec[16];
+} collector_t;
+
+static void collect(void *arg, const footlog_rec_t *r)
+{
+  collector_t *c = arg;
+
+  if (c->n < 16) c->rec[c->n++] = *r;
+}
+
+static void test_poll_api()
+/* A press long past is reported in full by one footlog_process() */
+{
+  footlog_t *fl;
+  footlog_rec_t r;
+  int64_t t = T0;
+  int fd;
+
+  now = t + 2000;
+
+  fl = open_fifo("/tmp/libfootlog_test.fifo", &fd, 0, 0);
+  CHECK(fl);
+  if (!fl) return;
+
+  CHECK(footlog_process(fl) == 0);
+  CHECK(footlog_timeout(fl) == -1);
+
+  press(fd, t, t + 500);
+  CHECK(footlog_process(fl) == 2);
+  CHECK(footlog_next(fl, &r) && r.kind == FOOTLOG_DOWN && r.time == t);
+  CHECK(footlog_next(fl, &r) && r.kind == FOOTLOG_UP && r.seqlen == 495
+	&& r.key1count == 16);
+  CHECK(!footlog_next(fl, &r));
+
+  close(fd);
+  footlog_close(fl);
+  unlink("/tmp/libfootlog_test.fifo");
+}
+
+static void test_two_contexts()
+/* Contexts are independent, and a press in progress ends on the
+   clock, exactly one gap after its last KEY_1 */
+{
+  footlog_t *a, *b;
+  collector_t ca, cb;
+  int fa, fb;
+  int64_t t = T0 + 10000;
+
+  now = t;
+  memset(&ca, 0, sizeof(ca));
+  memset(&cb, 0, sizeof(cb));
+  a = open_fifo("/tmp/libfootlog_test_a.fifo", &fa, collect, &ca);
+  b = open_fifo("/tmp/libfootlog_test_b.fifo", &fb, collect, &cb);
+  CHECK(a && b);
+  if (!a || !b) return;
+
+  press(fa, t - 99, t); /* last KEY_1 at t */
+  footlog_marker(b, "only in b");
+  CHECK(footlog_process(a) == 1); /* DOWN; UP only after the gap */
+  CHECK(footlog_timeout(a) == 200);
+  CHECK(footlog_process(b) == 0);
+
+  now = t + 199;
+  CHECK(footlog_timeout(a) == 1);
+  CHECK(footlog_process(a) == 0);
+  CHECK(ca.n == 1 && ca.rec[0].kind == FOOTLOG_DOWN);
+
+  now = t + 250; /* woke up late */
+  CHECK(footlog_timeout(a) == 0);
+  CHECK(footlog_wait(a, 1000) == 1); /* returns at once */
+  CHECK(ca.n == 2 && ca.rec[1].kind == FOOTLOG_UP && ca.rec[1].time == t
+	&& ca.rec[1].seqlen == 99);
+  CHECK(footlog_timeout(a) == -1);
+  CHECK(cb.n == 1 && cb.rec[0].kind == FOOTLOG_MARKER
+	&& cb.rec[0].time == t && !strcmp(cb.rec[0].text, "only in b"));
+
+  close(fa);
+  close(fb);
+  footlog_close(a);
+  footlog_close(b);
+  unlink("/tmp/libfootlog_test_a.fifo");
+  unlink("/tmp/libfootlog_test_b.fifo");
+}
+
+static void test_errors()
+{
+  footlog_config_t cf;
+
+  footlog_defaults(&cf);
+  cf.device = "/nonexistent/event0";
+  CHECK(!footlog_open(&cf, 0, 0) && errno == ENOENT);
+}
+
+int main()
+{
+  test_poll_api();
+  test_two_contexts();
+  test_errors();
+
+  return(check_result("libfootlog_test", 0));
+}
@@ -0,0 +1,199 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+#define _GNU_SOURCE /* for recvmmsg */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "footlog.h"
+
+/* Marker channel.  Stimulus software sends each marker as one
+   datagram to a UNIX socket (see footmark.h), which costs it a single
+   non-blocking send().  The kernel stamps each datagram on arrival
+   (SO_TIMESTAMP) with CLOCK_REALTIME, the same clock as evdev event
+   timestamps, so a marker's time does not depend on when footlog gets
+   round to reading it.  Markers are received before the event devices
+   are read in each wakeup, and each is handed to the detector just
+   before the first event stamped after it (the rest after the last
+   event), so the detector sees markers and events in time order. */
+
+char MarkerSocketName[BUFLEN] = ""; /* empty means no marker channel */
+int MarkerFd = -1;
+int MarkerQlen = 0; /* 0 means leave max_dgram_qlen alone; set by "-Q" */
+
+#define MARKBATCH 256 /* datagrams received per wakeup */
+#define MARKRCVBUF (1 << 20) /* socket buffer, for bursts */
+#define QLENPATH "/proc/sys/net/unix/max_dgram_qlen"
+
+static char marktext[MARKBATCH][MARKLEN];
+static int marklen[MARKBATCH];
+static mstime_t marktime[MARKBATCH];
+static int markhead, nmarks; /* not yet delivered: markhead..nmarks-1 */
+
+static void raise_qlen()
+/* The kernel queues at most max_dgram_qlen datagrams on a UNIX socket,
+   fixed when the socket is created.  The default of 10 is only 10 ms
+   of markers at 1 kHz; logevents() cuts its sleep short when a marker
+   arrives, but a burst from several senders can still overflow it.
+   Only on request ("-Q"), since this is a system-wide setting, and it
+   is left as it is at exit: raise it (never lower it) to MarkerQlen
+   before creating our socket */
+{
+  FILE *f;
+  int qlen;
+
+  f = fopen(QLENPATH, "r+");
+  if (!f) {
+    perror(QLENPATH);
+    return;
+  }
+  if (fscanf(f, "%d", &qlen) == 1 && qlen < MarkerQlen) {
+    rewind(f);
+    fprintf(f, "%d\n", MarkerQlen);
+    fprintf(stderr, "%s raised from %d to %d\n", QLENPATH, qlen, MarkerQlen);
+  }
+  if (fclose(f)) perror(QLENPATH); /* carry on with the smaller queue */
+}
+
+void marker_open()
+/* Create the marker socket at MarkerSocketName */
+{
+  struct sockaddr_un sa;
+  int on = 1, size = MARKRCVBUF;
+
+  if (MarkerQlen > 0) raise_qlen();
+
+  if (strlen(MarkerSocketName) >= sizeof(sa.sun_path)) {
+    fprintf(stderr, "Marker socket name too long: %s\n", MarkerSocketName);
+    exit(-1);
+  }
+
+  MarkerFd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (MarkerFd < 0) {
+    perror("socket");
+    exit(-1);
+  }
+
+  /* A stale socket from an earlier run would make bind() fail */
+  if (unlink(MarkerSocketName) < 0 && errno != ENOENT) {
+    perror(MarkerSocketName);
+    exit(-1);
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, MarkerSocketName);
+  if (bind(MarkerFd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+    perror(MarkerSocketName);
+    exit(-1);
+  }
+
+  /* footlog runs as root, stimulus software usually does not */
+  if (chmod(MarkerSocketName, 0666) < 0) {
+    perror(MarkerSocketName);
+    exit(-1);
+  }
+
+  if (setsockopt(MarkerFd, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) < 0) {
+    perror("SO_TIMESTAMP");
+    exit(-1);
+  }
+
+  /* As root we may exceed rmem_max; otherwise settle for what we get */
+  if (setsockopt(MarkerFd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+    setsockopt(MarkerFd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  if (DebugFlag) fprintf(stderr, "Marker socket %s is fd %d\n", MarkerSocketName, MarkerFd);
+}
+
+int marker_recv()
+/* Receive up to MARKBATCH pending markers with one recvmmsg(), and
+   hold them until marker_deliver().  Returns how many arrived */
+{
+  struct mmsghdr msgs[MARKBATCH];
+  struct iovec iov[MARKBATCH];
+  union {
+    char buf[CMSG_SPACE(sizeof(struct timeval))];
+    struct cmsghdr align;
+  } ctl[MARKBATCH];
+  struct cmsghdr *cm;
+  struct timeval tv;
+  int i, n, k;
+  char *s;
+
+  if (MarkerFd < 0) return(0);
+
+  if (markhead) {/* make room behind markers not yet delivered */
+    nmarks -= markhead;
+    memmove(marktext, marktext + markhead, nmarks * sizeof(marktext[0]));
+    memmove(marklen, marklen + markhead, nmarks * sizeof(marklen[0]));
+    memmove(marktime, marktime + markhead, nmarks * sizeof(marktime[0]));
+    markhead = 0;
+  }
+
+  memset(msgs, 0, sizeof(msgs));
+  for (i = nmarks; i < MARKBATCH; i++) {
+    iov[i].iov_base = marktext[i];
+    iov[i].iov_len = MARKLEN;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_control = ctl[i].buf;
+    msgs[i].msg_hdr.msg_controllen = sizeof(ctl[i].buf);
+  }
+
+  n = recvmmsg(MarkerFd, msgs + nmarks, MARKBATCH - nmarks, MSG_DONTWAIT, 0);
+  if (n < 0) {
+    if (errno != EAGAIN && errno != EINTR) perror("marker socket");
+    return(0);
+  }
+
+  for (i = nmarks; i < nmarks + n; i++) {
+    /* Arrival time; fall back to now if the kernel gave none */
+    gettimeofday(&tv, 0);
+    for (cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm)) {
+      if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMP)
+	memcpy(&tv, CMSG_DATA(cm), sizeof(tv));
+    }
+    marktime[i] = (mstime_t) tv.tv_sec*1000 + tv.tv_usec/1000;
+
+    /* One marker is one log line: drop a trailing newline and turn
+       any other control characters into blanks */
+    s = marktext[i];
+    k = msgs[i].msg_len;
+    if (k > MARKLEN) k = MARKLEN;
+    while (k > 0 && (s[k-1] == '\n' || s[k-1] == '\r')) k--;
+    marklen[i] = k;
+    while (k-- > 0) if ((unsigned char) s[k] < ' ' || s[k] == 0x7f) s[k] = ' ';
+  }
+  nmarks += n;
+  return(n);
+}
+
+void marker_deliver(detector_t *d, mstime_t upto)
+/* Hand the markers received so far that are stamped earlier than
+   upto to detector d, in arrival order; all of them if upto is
+   negative */
+{
+  while (markhead < nmarks && (upto < 0 || marktime[markhead] < upto)) {
+    detect_marker(d, marktime[markhead], marktext[markhead], marklen[markhead]);
+    markhead++;
+  }
+  if (markhead == nmarks) markhead = nmarks = 0;
+}
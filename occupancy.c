@@ -0,0 +1,235 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "occupancy.h"
+
+#define OCCLANES 16 /* queries searched in lockstep */
+
+
+static int by_start(const void *a, const void *b)
+{
+  const struct occrec *x = a, *y = b;
+
+  return((x->start > y->start) - (x->start < y->start));
+}
+
+int occ_build(occindex_t *x, const struct occrec *rec, long n)
+/* Build index x from n records in any order.  Empty intervals are
+   dropped and overlapping or touching ones merged.  Returns 0, or -1
+   if out of memory */
+{
+  struct occrec *r;
+  long i, k;
+
+  memset(x, 0, sizeof(*x));
+  r = malloc((n ? n : 1) * sizeof(*r));
+  x->start = malloc((n + 1) * sizeof(mstime_t));
+  x->end = malloc((n + 1) * sizeof(mstime_t));
+  x->before = malloc((n + 1) * sizeof(mstime_t));
+  if (!r || !x->start || !x->end || !x->before) {
+    free(r);
+    occ_free(x);
+    return(-1);
+  }
+
+  /* The daemon writes records in order, so this is usually a no-op
+     pass; a clock step can still put one out of place */
+  for (i = k = 0; i < n; i++) if (rec[i].end > rec[i].start) r[k++] = rec[i];
+  for (i = 1; i < k; i++) if (r[i].start < r[i-1].start) break;
+  if (i < k) qsort(r, k, sizeof(*r), by_start);
+
+  x->start[0] = x->end[0] = INT64_MIN;
+  x->before[0] = 0;
+  for (i = 0; i < k; i++) {
+    if (x->n && r[i].start <= x->end[x->n]) {
+      if (r[i].end > x->end[x->n]) x->end[x->n] = r[i].end;
+      continue;
+    }
+    x->n++;
+    x->start[x->n] = r[i].start;
+    x->end[x->n] = r[i].end;
+    x->before[x->n] = x->n > 1
+      ? x->before[x->n-1] + (x->end[x->n-1] - x->start[x->n-1]) : 0;
+  }
+  free(r);
+  return(0);
+}
+
+int occ_load(occindex_t *x, const char *path)
+/* Build index x from a sidecar file.  Returns 0, or -1 with errno set
+   (EINVAL if path is not an occupancy file) */
+{
+  struct occheader *hdr;
+  struct stat sb;
+  char *p;
+  long n;
+  int fd, rc, saved;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return(-1);
+  if (fstat(fd, &sb) < 0) goto ErrorExit;
+  if (sb.st_size < (off_t) sizeof(*hdr)) {
+    errno = EINVAL;
+    goto ErrorExit;
+  }
+
+  p = mmap(0, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) goto ErrorExit;
+  close(fd);
+
+  hdr = (struct occheader *) p;
+  if (memcmp(hdr->magic, OCCMAGIC, sizeof(hdr->magic))
+      || hdr->recsize != sizeof(struct occrec)) {
+    munmap(p, sb.st_size);
+    errno = EINVAL;
+    return(-1);
+  }
+  n = (sb.st_size - sizeof(*hdr)) / sizeof(struct occrec);
+  rc = occ_build(x, (struct occrec *) (p + sizeof(*hdr)), n);
+  saved = errno;
+  munmap(p, sb.st_size);
+  errno = saved;
+  return(rc);
+
+ ErrorExit:
+  saved = errno;
+  close(fd);
+  errno = saved;
+  return(-1);
+}
+
+void occ_free(occindex_t *x)
+{
+  free(x->start);
+  free(x->end);
+  free(x->before);
+  memset(x, 0, sizeof(*x));
+}
+
+
+static void search(const occindex_t *x, const mstime_t *t, long *idx, int m)
+/* For each of m times t[k], set idx[k] to the last run starting at or
+   before t[k].  Every lane takes the same number of steps, and each
+   step is a conditional move, not a branch, so there is nothing to
+   mispredict; the loads of all lanes are in flight together */
+{
+  const mstime_t *base[OCCLANES], *a = x->start;
+  long len = x->n + 1, half;
+  int k;
+
+  for (k = 0; k < m; k++) base[k] = a;
+  while (len > 1) {
+    half = len / 2;
+    for (k = 0; k < m; k++) {
+      __builtin_prefetch(base[k] + (len - half) / 2);
+      __builtin_prefetch(base[k] + half + (len - half) / 2);
+      base[k] = base[k][half] <= t[k] ? base[k] + half : base[k];
+    }
+    len -= half;
+  }
+  for (k = 0; k < m; k++) idx[k] = base[k] - a;
+}
+
+void occ_isdown(const occindex_t *x, const mstime_t *t, long n, unsigned char *down)
+/* down[k] = 1 if the pedal was down at time t[k], 0 if not */
+{
+  long idx[OCCLANES], i;
+  int k, m;
+
+  for (i = 0; i < n; i += m) {
+    m = n - i < OCCLANES ? n - i : OCCLANES;
+    search(x, t + i, idx, m);
+    for (k = 0; k < m; k++) down[i+k] = t[i+k] < x->end[idx[k]];
+  }
+}
+
+static inline mstime_t downbefore(const occindex_t *x, long i, mstime_t t)
+/* Total down time before t, given the last run i starting at or
+   before t */
+{
+  mstime_t e = x->end[i];
+
+  return(x->before[i] + (t < e ? t : e) - x->start[i]);
+}
+
+void occ_downtime(const occindex_t *x, const mstime_t *t1, const mstime_t *t2,
+		  long n, mstime_t *down)
+/* down[k] = milliseconds the pedal was down in [t1[k], t2[k]); each
+   t1[k] must not be after t2[k] */
+{
+  long idx1[OCCLANES], idx2[OCCLANES], i;
+  int k, m;
+
+  for (i = 0; i < n; i += m) {
+    m = n - i < OCCLANES ? n - i : OCCLANES;
+    search(x, t1 + i, idx1, m);
+    search(x, t2 + i, idx2, m);
+    for (k = 0; k < m; k++)
+      down[i+k] = downbefore(x, idx2[k], t2[i+k]) - downbefore(x, idx1[k], t1[i+k]);
+  }
+}
+
+
+int occ_create(const char *path)
+/* Create an empty sidecar file at path; returns its fd, or -1 with
+   errno set */
+{
+  struct occheader hdr;
+  int fd, saved;
+
+  fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND|O_CLOEXEC, 0644);
+  if (fd < 0) return(-1);
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, OCCMAGIC, sizeof(hdr.magic));
+  hdr.recsize = sizeof(struct occrec);
+  if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+    saved = errno;
+    close(fd);
+    errno = saved;
+    return(-1);
+  }
+  return(fd);
+}
+
+int occ_append(int fd, mstime_t start, mstime_t end)
+/* Append the press [start, end) to a sidecar file.  One write() of one
+   record, so a reader never sees part of one except after a crash.
+   Returns 0, or -1 with errno set */
+{
+  struct occrec r;
+
+  r.start = start;
+  r.end = end;
+  if (write(fd, &r, sizeof(r)) != sizeof(r)) return(-1);
+  return(0);
+}
+
+void sidecar_name(char *name, int size, const char *logname, const char *suffix)
+/* Derive name of a file kept next to a log file, such as its capture,
+   by replacing a ".log" suffix with the given one (or appending it) */
+{
+  int len;
+
+  len = strlen(logname);
+  if (len > 4 && !strcmp(logname + len - 4, ".log")) len -= 4;
+  snprintf(name, size-1, "%.*s%s", len, logname, suffix);
+}
@@ -0,0 +1,65 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Pedal occupancy timeline.  The presses of a session, as half-open
+   intervals [DOWN, UP) in milliseconds, kept sorted and merged so
+   that "was the pedal down at t?" and "how long was it down in
+   [t1,t2)?" are a binary search each.  The daemon appends one record
+   per press to a sidecar file next to the log ("-o"); footocc builds
+   the same timeline from the text of older logs.
+
+   Lookups take arrays of times, so that analyses joining against
+   dense signals pay one call for millions of samples.  The search is
+   branch-free and runs a group of queries in lockstep, so their cache
+   misses overlap instead of waiting on one another. */
+
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include "detect.h"
+
+/* Sidecar file: header, then one record per press in the order the
+   presses ended.  A torn record at the end (crash while writing) is
+   ignored when loading */
+#define OCCMAGIC "FOOTOCC1"
+
+struct occheader {
+  char magic[8];
+  uint32_t recsize; /* sizeof(struct occrec) */
+  uint32_t pad;
+};
+
+struct occrec {
+  int64_t start;    /* DOWN, ms since the epoch */
+  int64_t end;      /* UP; the pedal is down in [start, end) */
+};
+
+/* In memory: runs in time order, overlapping ones merged.  Entry 0 is
+   a sentinel that starts and ends before any time, so every search
+   finds some run at or before its time */
+typedef struct occindex {
+  long n;           /* real runs, in entries 1..n */
+  mstime_t *start;
+  mstime_t *end;
+  mstime_t *before; /* total down time in all runs before this one */
+} occindex_t;
+
+extern int occ_build(occindex_t *, const struct occrec *, long);
+extern int occ_load(occindex_t *, const char *);
+extern void occ_free(occindex_t *);
+extern void occ_isdown(const occindex_t *, const mstime_t *, long, unsigned char *);
+extern void occ_downtime(const occindex_t *, const mstime_t *, const mstime_t *, long,
+			 mstime_t *);
+extern int occ_create(const char *);
+extern int occ_append(int, mstime_t, mstime_t);
+
+/* Name of a file kept next to a log, such as its capture or
+   occupancy sidecar: "events.log" becomes "events<suffix>" */
+extern void sidecar_name(char *, int, const char *, const char *);
+
+#endif /* OCCUPANCY_H */
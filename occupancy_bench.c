@@ -0,0 +1,114 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Microbenchmark for the occupancy lookups in occupancy.c.  Run by
+   "make bench".  Point and range queries at random times, against
+   timelines from a short session to years of presses, compared with
+   a plain one-at-a-time binary search. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "occupancy.h"
+
+#define NQUERIES (4 << 20)
+#define ROUNDS 3
+
+static double seconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void plain_isdown(const occindex_t *x, const mstime_t *t, long n, unsigned char *down)
+/* Textbook binary search, for comparison */
+{
+  long i, lo, hi, mid;
+
+  for (i = 0; i < n; i++) {
+    lo = 0;
+    hi = x->n;
+    while (lo < hi) {
+      mid = (lo + hi + 1) / 2;
+      if (x->start[mid] <= t[i]) lo = mid;
+      else hi = mid - 1;
+    }
+    down[i] = t[i] < x->end[lo];
+  }
+}
+
+static void run(long nruns, mstime_t *t, mstime_t *t2, unsigned char *down, mstime_t *d)
+{
+  struct occrec *r;
+  occindex_t x;
+  mstime_t now = 1637000000000LL;
+  double t0, best[3] = {1e9, 1e9, 1e9};
+  long i, sum = 0;
+  int k;
+
+  r = malloc(nruns * sizeof(*r));
+  for (i = 0; i < nruns; i++) {
+    r[i].start = now + random() % 10000;
+    r[i].end = r[i].start + 50 + random() % 4000;
+    now = r[i].end;
+  }
+  occ_build(&x, r, nruns);
+  free(r);
+
+  for (i = 0; i < NQUERIES; i++) {
+    t[i] = 1637000000000LL + ((long) random() << 31 | random()) % (now - 1637000000000LL);
+    t2[i] = t[i] + random() % 60000;
+  }
+
+  for (k = 0; k < ROUNDS; k++) {
+    t0 = seconds();
+    plain_isdown(&x, t, NQUERIES, down);
+    t0 = seconds() - t0;
+    if (t0 < best[0]) best[0] = t0;
+
+    t0 = seconds();
+    occ_isdown(&x, t, NQUERIES, down);
+    t0 = seconds() - t0;
+    if (t0 < best[1]) best[1] = t0;
+
+    t0 = seconds();
+    occ_downtime(&x, t, t2, NQUERIES, d);
+    t0 = seconds() - t0;
+    if (t0 < best[2]) best[2] = t0;
+  }
+  for (i = 0; i < NQUERIES; i++) sum += down[i] + d[i];
+
+  printf("%9ld runs  plain %6.1f ns/query  isdown %6.1f ns/query  downtime %6.1f ns/query  (%ld)\n",
+	 nruns, best[0] * 1e9 / NQUERIES, best[1] * 1e9 / NQUERIES,
+	 best[2] * 1e9 / NQUERIES, sum % 10);
+  occ_free(&x);
+}
+
+int main()
+{
+  mstime_t *t, *t2, *d;
+  unsigned char *down;
+
+  t = malloc(NQUERIES * sizeof(*t));
+  t2 = malloc(NQUERIES * sizeof(*t2));
+  d = malloc(NQUERIES * sizeof(*d));
+  down = malloc(NQUERIES);
+  if (!t || !t2 || !d || !down) {
+    perror("malloc");
+    return(1);
+  }
+  srandom(1);
+
+  run(1000, t, t2, down, d);
+  run(100000, t, t2, down, d);
+  run(10000000, t, t2, down, d);
+  return(0);
+}
@@ -0,0 +1,148 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Tests for the occupancy timeline in occupancy.c.  Run by "make
+   test".  Random press sets, overlapping and out of order, are checked
+   against a brute-force scan of the same presses. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "occupancy.h"
+#include "check.h"
+
+#define T0 1637000000000LL
+
+static int brute_isdown(const struct occrec *r, long n, mstime_t t)
+{
+  long i;
+
+  for (i = 0; i < n; i++) if (r[i].start <= t && t < r[i].end) return(1);
+  return(0);
+}
+
+static mstime_t brute_downtime(const struct occrec *r, long n, mstime_t t1, mstime_t t2)
+/* One millisecond at a time; fine for the short ranges used here */
+{
+  mstime_t t, down = 0;
+
+  for (t = t1; t < t2; t++) down += brute_isdown(r, n, t);
+  return(down);
+}
+
+static void test_empty()
+{
+  occindex_t x;
+  mstime_t t[3] = {0, T0, INT64_MAX}, d[3];
+  unsigned char down[3];
+
+  CHECK(occ_build(&x, 0, 0) == 0);
+  occ_isdown(&x, t, 3, down);
+  CHECK(!down[0] && !down[1] && !down[2]);
+  occ_downtime(&x, t, t + 1, 2, d);
+  CHECK(d[0] == 0 && d[1] == 0);
+  occ_free(&x);
+}
+
+static void test_edges()
+/* Intervals are half-open; touching and overlapping ones merge */
+{
+  struct occrec r[] = {{T0 + 500, T0 + 600}, {T0, T0 + 100},
+		       {T0 + 100, T0 + 200}, {T0 + 550, T0 + 700}, {T0 + 900, T0 + 900}};
+  occindex_t x;
+  mstime_t t[] = {T0 - 1, T0, T0 + 199, T0 + 200, T0 + 699, T0 + 700, T0 + 900};
+  unsigned char down[7];
+  mstime_t t1 = T0 - 1000, t2 = T0 + 1000, d;
+
+  CHECK(occ_build(&x, r, 5) == 0);
+  CHECK(x.n == 2);
+  occ_isdown(&x, t, 7, down);
+  CHECK(!down[0] && down[1] && down[2] && !down[3] && down[4] && !down[5] && !down[6]);
+  occ_downtime(&x, &t1, &t2, 1, &d);
+  CHECK(d == 400);
+  occ_free(&x);
+}
+
+static void test_random_property()
+{
+  struct occrec r[300];
+  occindex_t x;
+  mstime_t t[5000], t2[5000], d[5000];
+  unsigned char down[5000];
+  long i, n;
+  int round;
+
+  srandom(5);
+  for (round = 0; round < 20; round++) {
+    n = random() % 300;
+    for (i = 0; i < n; i++) {
+      r[i].start = T0 + random() % 100000;
+      r[i].end = r[i].start + random() % 2000;
+    }
+    CHECK(occ_build(&x, r, n) == 0);
+
+    for (i = 0; i < 5000; i++) {
+      t[i] = T0 - 1000 + random() % 103000;
+      t2[i] = t[i] + random() % 3000;
+    }
+    occ_isdown(&x, t, 5000, down);
+    occ_downtime(&x, t, t2, 5000, d);
+    for (i = 0; i < 5000; i++) {
+      CHECK(down[i] == brute_isdown(r, n, t[i]));
+      if (i % 10 == 0) CHECK(d[i] == brute_downtime(r, n, t[i], t2[i]));
+    }
+    occ_free(&x);
+  }
+}
+
+static void test_sidecar()
+/* Round trip through the file, with a torn record at the end */
+{
+  const char *path = "/tmp/occupancy_test.occ";
+  occindex_t x;
+  mstime_t t[3] = {T0 + 50, T0 + 150, T0 + 250};
+  unsigned char down[3];
+  FILE *f;
+  int fd;
+
+  fd = occ_create(path);
+  CHECK(fd >= 0);
+  if (fd < 0) return;
+  CHECK(occ_append(fd, T0, T0 + 100) == 0);
+  CHECK(occ_append(fd, T0 + 200, T0 + 300) == 0);
+  CHECK(write(fd, "torn", 4) == 4);
+  close(fd);
+
+  CHECK(occ_load(&x, path) == 0);
+  CHECK(x.n == 2);
+  occ_isdown(&x, t, 3, down);
+  CHECK(down[0] && !down[1] && down[2]);
+  occ_free(&x);
+
+  /* not a sidecar at all */
+  f = fopen(path, "w");
+  fprintf(f, "1637000000.000: DOWN\n");
+  fclose(f);
+  CHECK(occ_load(&x, path) < 0 && errno == EINVAL);
+
+  CHECK(occ_load(&x, "/tmp/occupancy_test_missing.occ") < 0 && errno == ENOENT);
+  unlink(path);
+}
+
+int main()
+{
+  test_empty();
+  test_edges();
+  test_random_property();
+  test_sidecar();
+
+  return(check_result("occupancy_test", 0));
+}
@@ -0,0 +1,168 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+#define _GNU_SOURCE /* for versionsort */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+
+#include "pedal.h"
+
+#define DEV_INPUT_EVENT "/dev/input"
+
+#define NBITS(x) ((((x)-1)/(sizeof(long)*8))+1)
+#define test_bit(bit, array) ((array[(bit)/(sizeof(long)*8)] >> ((bit)%(sizeof(long)*8))) & 1)
+
+int pedal_discover(const char *match, pedalusb_t *u)
+/* Find the first USB device whose lsusb line contains match, and fill
+   *u from that line.  Returns 0 on success, -1 with errno set
+   otherwise (ENODEV if there is no such device) */
+{
+  char oneline[1000];
+  FILE *f;
+  int found = 0;
+
+  f = popen("lsusb", "r");
+  if (!f) return(-1);
+  while (fgets(oneline, sizeof(oneline), f)) {
+    if (!strstr(oneline, match)) continue;
+    /* Can't use %s for the description because of possible whitespace */
+    if (sscanf(oneline, "Bus %7s Device %7[^:]: ID %7[^:]:%7s%255[^\n]",
+	       u->bus, u->device, u->id1, u->id2, u->description) == 5) {
+      found = 1;
+      break;
+    }
+  }
+  pclose(f);
+
+  if (!found) {
+    errno = ENODEV;
+    return(-1);
+  }
+  return(0);
+}
+
+static int is_event_device(const struct dirent *dir)
+/* Filter for scandir() in pedal_find_devices() */
+{
+  return(!strncmp("event", dir->d_name, 5));
+}
+
+int pedal_find_devices(const char *id1, const char *id2, char path[][PEDALPATHLEN], int max)
+/* Fill path[] with the event devices of the pedal with USB ids
+   id1:id2, in version order: those whose name contains "HID
+   <id1>:<id2>".  Returns how many, or
+   -1 with errno set: ENODEV if there are none, E2BIG if more than max */
+{
+  struct dirent **namelist;
+  char fname[PEDALPATHLEN], target[64], name[256];
+  int i, fd, ndev, n = 0;
+
+  snprintf(target, sizeof(target), "HID %s:%s", id1, id2);
+
+  ndev = scandir(DEV_INPUT_EVENT, &namelist, is_event_device, versionsort);
+  if (ndev < 0) return(-1);
+  for (i = 0; i < ndev; i++) {
+    snprintf(fname, sizeof(fname), "%s/%s", DEV_INPUT_EVENT, namelist[i]->d_name);
+    free(namelist[i]); /* allocated in bulk by scandir(); free one by one */
+
+    fd = open(fname, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) continue; /* don't know why it failed, just ignore */
+    strcpy(name, "???");
+    ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+    close(fd);
+
+    if (!strstr(name, target)) continue;
+    if (n < max) strcpy(path[n], fname);
+    n++;
+  }
+  free(namelist);
+
+  if (n > max) errno = E2BIG;
+  else if (!n) errno = ENODEV;
+  return(n && n <= max ? n : -1);
+}
+
+int pedal_abs_thresholds(const int *fd, int ndev, int *axis, int *high, int *low,
+			 int sethigh, int setlow)
+/* Find the analog axis on devices fd[0..ndev-1]: *axis if it is not
+   negative, else the first one reported, which is stored in *axis.
+   Unless sethigh or setlow say they were given, derive *high and
+   *low from its range: press at 30% of travel, release at 15%.
+   Returns 0, or -1 with errno set to ENODEV if there is no such axis */
+{
+  unsigned long absbits[NBITS(ABS_CNT)];
+  struct input_absinfo ai;
+  int i, k, range;
+
+  for (i = 0; i < ndev; i++) {
+    memset(absbits, 0, sizeof(absbits));
+    if (ioctl(fd[i], EVIOCGBIT(EV_ABS, sizeof(absbits)), absbits) < 0)
+      continue;
+    for (k = 0; k <= ABS_MAX; k++) {
+      if (*axis >= 0 && k != *axis) continue;
+      if (!test_bit(k, absbits)) continue;
+      if (ioctl(fd[i], EVIOCGABS(k), &ai) < 0) continue;
+
+      *axis = k;
+      range = ai.maximum - ai.minimum;
+      if (!sethigh) *high = ai.minimum + (range*30)/100;
+      if (!setlow) *low = ai.minimum + (range*15)/100;
+      return(0);
+    }
+  }
+  errno = ENODEV;
+  return(-1);
+}
+
+struct input_event *pedal_merge_next(pedalmerge_t *m, int *dev)
+/* Return the earliest unconsumed event in the merge buffer, and the
+   index of its device in *dev; null when all are consumed.  Ties go
+   to the lower device index, so the merge is stable */
+{
+  int j, best = -1;
+
+  for (j = 0; j < m->ndev; j++) {
+    if (m->head[j] >= m->count[j]) continue;
+    if (best < 0 || timercmp(&m->buf[j][m->head[j]].time,
+			     &m->buf[best][m->head[best]].time, <))
+      best = j;
+  }
+  if (best < 0) return(0);
+
+  *dev = best;
+  return(&m->buf[best][m->head[best]++]);
+}
+
+mstime_t pedal_evtime(const struct input_event *e)
+/* Timestamp of event e in milliseconds, as the detector wants it */
+{
+  return((mstime_t) e->time.tv_sec*1000 + e->time.tv_usec/1000);
+}
+
+mstime_t pedal_clock(void *arg)
+/* Detector clock, in the same domain as the event timestamps (evdev
+   uses CLOCK_REALTIME unless told otherwise) */
+{
+  struct timespec ts;
+
+  (void) arg;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return((mstime_t) ts.tv_sec*1000 + ts.tv_nsec/1000000);
+}
@@ -0,0 +1,53 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Finding the pedal and reading its events: the parts shared by the
+   footlog daemon (usbstuff.c, evstuff.c) and libfootlog.so.  Like
+   detect.c, nothing here exits, prints or keeps global state; errors
+   come back as -1 with errno set, and each caller reports them in its
+   own way. */
+
+#ifndef PEDAL_H
+#define PEDAL_H
+
+#include <linux/input.h>
+
+#include "detect.h"
+
+#define PEDALUSBMATCH "QinHeng Electronics" /* lsusb description */
+#define PEDALDEVMAX 6    /* event devices per pedal; 1 or 2 is typical */
+#define PEDALBATCH 256   /* events read from a device at a time; room
+			    for a burst from an analog pedal */
+#define PEDALPATHLEN 300
+
+/* What lsusb says about the pedal */
+typedef struct pedalusb {
+  char bus[8], device[8];
+  char id1[8], id2[8];     /* vendor and product id, in hex */
+  char description[256];
+} pedalusb_t;
+
+/* Merge buffer: the events read from each device node in one wakeup,
+   and how far each node's events have been consumed.  Each node's
+   events are already in timestamp order, so merging only has to
+   compare the heads of at most PEDALDEVMAX runs */
+typedef struct pedalmerge {
+  int ndev;
+  struct input_event buf[PEDALDEVMAX][PEDALBATCH];
+  int count[PEDALDEVMAX];
+  int head[PEDALDEVMAX];
+} pedalmerge_t;
+
+extern int pedal_discover(const char *, pedalusb_t *);
+extern int pedal_find_devices(const char *, const char *, char [][PEDALPATHLEN], int);
+extern int pedal_abs_thresholds(const int *, int, int *, int *, int *, int, int);
+extern struct input_event *pedal_merge_next(pedalmerge_t *, int *);
+extern mstime_t pedal_evtime(const struct input_event *);
+extern mstime_t pedal_clock(void *);
+
+#endif /* PEDAL_H */
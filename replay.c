@@ -0,0 +1,284 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <string.h>
+#include <libgen.h>
+#include <linux/input.h>
+
+#include "footlog.h"
+#include "occupancy.h"
+
+/* Offline replay of a captured event stream.  The capture is either a
+   file written by "footlog -c", or a plain sequence of struct
+   input_event, exactly as read() returns them from /dev/input/event*.
+   Each (GapSize, RuntMax, DetectMode) combination is replayed by its
+   own child process, up to one per online CPU.  The events are loaded
+   once before forking and never written, so all children share the
+   same pages. */
+
+#define REPLAYMAX 32 /* maximum number of values in one list */
+
+static const char * const modenames[] = {
+  [DETECT_KEY] = "key",
+  [DETECT_ABS] = "abs"
+};
+
+static int parse_list(char *list, int dflt, int ismode, int *vals)
+/* Parse comma-separated list into vals[]; return number of values.
+   A null list yields the single value dflt.  A value given twice is
+   kept once, since both would replay into the same log file.  Exit
+   on bad values */
+{
+  char *copy, *tok, *save, *end;
+  int n = 0, k;
+
+  if (!list) {
+    vals[0] = dflt;
+    return(1);
+  }
+
+  copy = strdup(list);
+  for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(0, ",", &save)) {
+    if (n >= REPLAYMAX) {
+      fprintf(stderr, "Too many values in \"%s\", limit is %d\n", list, REPLAYMAX);
+      exit(-1);
+    }
+    if (ismode) {
+      if (!strcmp(tok, "key")) vals[n] = DETECT_KEY;
+      else if (!strcmp(tok, "abs")) vals[n] = DETECT_ABS;
+      else goto BadValue;
+    }
+    else {
+      vals[n] = strtol(tok, &end, 10);
+      if (*end || vals[n] < 0) goto BadValue;
+    }
+    for (k = 0; k < n && vals[k] != vals[n]; k++) ;
+    if (k < n) {
+      fprintf(stderr, "Ignoring repeated \"%s\" in \"%s\"\n", tok, list);
+      continue;
+    }
+    n++;
+  }
+  free(copy);
+  if (!n) goto BadValue;
+  return(n);
+
+ BadValue:
+  fprintf(stderr, "Can't understand list \"%s\"\n", list);
+  exit(-1);
+}
+
+static void replay_name(char *name, int size)
+/* Construct name of log file for the current combination, derived
+   from LogFileName: "events.log" becomes "events-g1000-r10-key.log" */
+{
+  char suffix[64];
+
+  snprintf(suffix, sizeof(suffix), "-g%d-r%d-%s.log",
+	   GapSize, RuntMax, modenames[DetectMode]);
+  sidecar_name(name, size, LogFileName, suffix);
+}
+
+static void replay_one(struct input_event *ev, long numev)
+/* Runs in a child process, with the globals set for one combination */
+{
+  char name[BUFLEN];
+
+  replay_name(name, sizeof(name));
+  LogFile = fopen(name, "w");
+  if (!LogFile) {
+    perror(name);
+    _exit(1);
+  }
+  setvbuf(LogFile, NULL, _IOFBF, 1 << 16);
+
+  if (OccupancyFlag) {
+    sidecar_name(OccupancyFileName, BUFLEN, name, ".occ");
+    OccupancyFd = occ_create(OccupancyFileName);
+    if (OccupancyFd < 0) {
+      perror(OccupancyFileName);
+      _exit(1);
+    }
+  }
+
+  replay_events(ev, numev);
+
+  if (fclose(LogFile)) {
+    perror(name);
+    _exit(1);
+  }
+  if (DebugFlag) fprintf(stderr, "Wrote %s\n", name);
+  _exit(0);
+}
+
+static int reap()
+/* Wait for any child; returns 1 if it failed, 0 if it succeeded, -1
+   if there is no child left to wait for */
+{
+  int status;
+
+  while (wait(&status) < 0) {
+    if (errno != EINTR) return(-1);
+  }
+  return(!WIFEXITED(status) || WEXITSTATUS(status));
+}
+
+int replay()
+/* Replay ReplayFileName for every combination of the lists given on
+   the command line.  Returns 0 if every replay succeeded, -1 otherwise */
+{
+  int gaps[REPLAYMAX], runts[REPLAYMAX], modes[REPLAYMAX];
+  int ngaps, nruns, nmodes, g, r, m, fd, rc;
+  int ncpu, running = 0, failed = 0, total = 0;
+  struct input_event *ev;
+  struct capheader *hdr;
+  struct caprec *rec;
+  struct stat sb;
+  long i, numev;
+  pid_t pid;
+  char *lfn, *dn;
+
+  ngaps = parse_list(GapList, GapSize, 0, gaps);
+  nruns = parse_list(RuntList, RuntMax, 0, runts);
+  nmodes = parse_list(ModeList, DetectMode, 1, modes);
+
+  /* No device to ask for an axis or its range, so all must be given */
+  for (m = 0; m < nmodes; m++) {
+    if (modes[m] == DETECT_ABS
+	&& (AbsAxis < 0 || !AbsHighSet || !AbsLowSet || AbsLow >= AbsHigh)) {
+      fprintf(stderr, "Replay in abs mode needs -A <axis>, -H <high> and -L <low>, with low < high\n");
+      return(-1);
+    }
+  }
+
+  /* Map the capture */
+  fd = open(ReplayFileName, O_RDONLY);
+  if (fd < 0) {
+    perror(ReplayFileName);
+    return(-1);
+  }
+  if (fstat(fd, &sb) < 0) {
+    perror(ReplayFileName);
+    return(-1);
+  }
+  if (!sb.st_size) {
+    fprintf(stderr, "No events in %s\n", ReplayFileName);
+    return(-1);
+  }
+  hdr = mmap(0, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (hdr == MAP_FAILED) {
+    perror(ReplayFileName);
+    return(-1);
+  }
+  close(fd);
+  madvise(hdr, sb.st_size, MADV_SEQUENTIAL);
+
+  if (sb.st_size >= (off_t) sizeof(*hdr) && !memcmp(hdr->magic, CAPMAGIC, sizeof(hdr->magic))) {
+    /* Capture written by "footlog -c"; expand it once here, before
+       forking, so that the children share the expanded copy */
+    if (hdr->recsize != sizeof(struct caprec)) {
+      fprintf(stderr, "%s: record size %u, expected %d\n", ReplayFileName,
+	      hdr->recsize, (int) sizeof(struct caprec));
+      return(-1);
+    }
+    numev = (sb.st_size - sizeof(*hdr)) / sizeof(struct caprec);
+    if ((sb.st_size - sizeof(*hdr)) % sizeof(struct caprec))
+      fprintf(stderr, "Ignoring partial event at end of %s\n", ReplayFileName);
+    ev = malloc((numev + 1) * sizeof(struct input_event));
+    if (!ev) {
+      perror("malloc");
+      return(-1);
+    }
+    rec = (struct caprec *) (hdr + 1);
+    for (i = 0; i < numev; i++) {
+      ev[i].time.tv_sec = rec[i].sec;
+      ev[i].time.tv_usec = CAPUSEC(&rec[i]);
+      ev[i].type = rec[i].type;
+      ev[i].code = rec[i].code;
+      ev[i].value = rec[i].value;
+    }
+    munmap(hdr, sb.st_size);
+  }
+  else {
+    /* Plain stream of struct input_event; use the mapping directly */
+    numev = sb.st_size / sizeof(struct input_event);
+    if (sb.st_size % sizeof(struct input_event))
+      fprintf(stderr, "Ignoring partial event at end of %s\n", ReplayFileName);
+    ev = (struct input_event *) hdr;
+  }
+  if (!numev) {
+    fprintf(stderr, "No events in %s\n", ReplayFileName);
+    return(-1);
+  }
+
+  /* make the log directory, ignoring error if it already exists */
+  lfn = strdup(LogFileName);
+  dn = dirname(lfn);
+  rc = mkdir(dn, 0755);
+  if (rc < 0 && errno != EEXIST) {
+    perror(dn);
+    return(-1);
+  }
+  free(lfn);
+
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpu < 1) ncpu = 1;
+  if (DebugFlag) fprintf(stderr, "Replaying %ld events, %d combinations on %d cpus\n",
+			 numev, ngaps*nruns*nmodes, ncpu);
+
+  /* Fork one child per combination, keeping at most ncpu running */
+  for (g = 0; g < ngaps; g++) {
+    for (r = 0; r < nruns; r++) {
+      for (m = 0; m < nmodes; m++) {
+	if (running >= ncpu) {
+	  rc = reap();
+	  if (rc < 0) running = 0; /* none left after all */
+	  else {
+	    running--;
+	    failed += rc;
+	  }
+	}
+
+	GapSize = gaps[g];
+	RuntMax = runts[r];
+	DetectMode = modes[m];
+
+	pid = fork();
+	if (pid < 0) {
+	  perror("fork");
+	  exit(-1);
+	}
+	if (!pid) replay_one(ev, numev); /* does not return */
+	running++;
+	total++;
+      }
+    }
+  }
+
+  while (running > 0 && (rc = reap()) >= 0) {
+    running--;
+    failed += rc;
+  }
+
+  fprintf(stderr, "Replayed %ld events into %d logs, %d failed\n",
+	  numev, total, failed);
+  return(failed ? -1 : 0);
+}
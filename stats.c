@@ -0,0 +1,180 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stats.h"
+
+#define EMPTY INT64_MIN /* statswin_t.newest before any data */
+
+
+void stats_init(stats_t *s, const int *seconds, int nwin, mstime_t start)
+/* Track windows of the given lengths in seconds, from time start */
+{
+  statswin_t *w;
+  int k;
+
+  memset(s, 0, sizeof(*s));
+  if (nwin > STATSMAXWIN) nwin = STATSMAXWIN;
+  for (k = 0; k < nwin; k++) {
+    w = &s->win[k];
+    w->seconds = seconds[k];
+    w->bucketms = (seconds[k] * 1000) / STATSBUCKETS;
+    if (w->bucketms < 1) w->bucketms = 1;
+    w->newest = EMPTY;
+  }
+  s->nwin = nwin;
+  s->start = start;
+}
+
+
+static int slot(statswin_t *w, mstime_t t)
+/* Return ring index of the bucket holding time t, first moving the
+   ring forward if t is newer than the newest bucket.  Returns -1 if
+   t is too old to be in the window any more */
+{
+  int64_t b, k;
+  int i;
+
+  b = t / w->bucketms;
+  if (b > w->newest) {
+    if (w->newest == EMPTY || b - w->newest >= STATSBUCKETS) {
+      memset(w->downms, 0, sizeof(w->downms));
+      memset(w->presses, 0, sizeof(w->presses));
+      w->sumdown = 0;
+      w->sumpresses = 0;
+    }
+    else {
+      /* buckets falling out of the window; at most STATSBUCKETS */
+      for (k = w->newest + 1; k <= b; k++) {
+	i = k % STATSBUCKETS;
+	w->sumdown -= w->downms[i];
+	w->sumpresses -= w->presses[i];
+	w->downms[i] = 0;
+	w->presses[i] = 0;
+      }
+    }
+    w->newest = b;
+  }
+  if (b <= w->newest - STATSBUCKETS) return(-1);
+  return(b % STATSBUCKETS);
+}
+
+
+void stats_credit(stats_t *s, mstime_t upto)
+/* Account pedal down time from s->credited up to upto.  Called at the
+   end of a press, and by the daemon whenever it is about to report */
+{
+  statswin_t *w;
+  mstime_t t, end, seg;
+  int k, i;
+
+  if (!s->down || upto <= s->credited) return;
+
+  for (k = 0; k < s->nwin; k++) {
+    w = &s->win[k];
+    slot(w, upto);
+
+    /* Split [credited, upto) at bucket boundaries; anything older
+       than the window is of no interest */
+    t = s->credited;
+    if (t < (w->newest - STATSBUCKETS + 1) * w->bucketms)
+      t = (w->newest - STATSBUCKETS + 1) * w->bucketms;
+    while (t < upto) {
+      end = (t / w->bucketms + 1) * w->bucketms;
+      seg = (upto < end ? upto : end) - t;
+      i = slot(w, t);
+      if (i >= 0) {
+	w->downms[i] += seg;
+	w->sumdown += seg;
+      }
+      t += seg;
+    }
+  }
+  s->credited = upto;
+}
+
+
+void stats_down(stats_t *s, mstime_t t)
+/* The pedal went down at time t */
+{
+  statswin_t *w;
+  int k, i;
+
+  if (s->down) stats_credit(s, t);
+  for (k = 0; k < s->nwin; k++) {
+    w = &s->win[k];
+    i = slot(w, t);
+    if (i < 0) continue;
+    w->presses[i]++;
+    w->sumpresses++;
+  }
+  s->down = 1;
+  s->credited = t;
+}
+
+
+void stats_up(stats_t *s, mstime_t t)
+/* The pedal went up at time t */
+{
+  stats_credit(s, t);
+  s->down = 0;
+}
+
+
+void stats_query(stats_t *s, int k, mstime_t now,
+		 double *downfrac, double *perminute)
+/* Report for window k, as of time now: the fraction of the window the
+   pedal was down (as far as credited), and presses per minute */
+{
+  statswin_t *w = &s->win[k];
+  mstime_t from, span;
+
+  slot(w, now);
+  from = (w->newest - STATSBUCKETS + 1) * w->bucketms;
+  if (from < s->start) from = s->start;
+  span = now - from;
+  if (span <= 0) {
+    *downfrac = 0;
+    *perminute = 0;
+    return;
+  }
+  *downfrac = (double) w->sumdown / span;
+  if (*downfrac > 1) *downfrac = 1;
+  *perminute = w->sumpresses * 60000.0 / span;
+}
+
+
+int stats_write(stats_t *s, mstime_t now, const char *path)
+/* Write a snapshot of all windows to path, one line per window.  The
+   file is replaced atomically, so readers never see a partial one.
+   Returns 0 on success, -1 on error with errno set */
+{
+  char tmp[1000];
+  double downfrac, perminute;
+  FILE *f;
+  int k;
+
+  snprintf(tmp, sizeof(tmp)-1, "%s.tmp", path);
+  f = fopen(tmp, "w");
+  if (!f) return(-1);
+
+  for (k = 0; k < s->nwin; k++) {
+    stats_query(s, k, now, &downfrac, &perminute);
+    fprintf(f, "%lld.%03lld: window = %d s  down = %.4f  presses/min = %.2f\n",
+	    (long long) now/1000, (long long) now%1000, s->win[k].seconds,
+	    downfrac, perminute);
+  }
+  if (fclose(f)) return(-1);
+  return(rename(tmp, path));
+}
@@ -0,0 +1,53 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Rolling-window pedal statistics: the fraction of the last N seconds
+   the pedal was down, and presses per minute, for a few window
+   lengths at once.  Each window is a ring of STATSBUCKETS buckets
+   with running totals, so updates and queries cost O(1) amortized
+   however long the window; the price is that the oldest bucket drops
+   out all at once, a resolution of N/STATSBUCKETS seconds.  A window
+   is the current, partly elapsed, bucket and the STATSBUCKETS-1
+   before it.  The caller reports presses as they start and end, and
+   credits down time in between with stats_credit() before querying a
+   press still in progress. */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "detect.h"
+
+#define STATSBUCKETS 60
+#define STATSMAXWIN 8   /* window lengths tracked at once */
+
+typedef struct statswin {
+  int seconds;        /* window length */
+  int bucketms;       /* milliseconds per bucket */
+  int64_t newest;     /* bucket number (time / bucketms) of newest */
+  int downms[STATSBUCKETS];  /* pedal down time in each bucket */
+  int presses[STATSBUCKETS]; /* presses starting in each bucket */
+  int64_t sumdown;    /* totals over all buckets */
+  int sumpresses;
+} statswin_t;
+
+typedef struct stats {
+  int nwin;
+  statswin_t win[STATSMAXWIN];
+  int down;           /* pedal is down */
+  mstime_t credited;  /* down time accounted for up to here */
+  mstime_t start;     /* no data before this; windows are shorter */
+} stats_t;
+
+extern void stats_init(stats_t *, const int *, int, mstime_t);
+extern void stats_down(stats_t *, mstime_t);
+extern void stats_up(stats_t *, mstime_t);
+extern void stats_credit(stats_t *, mstime_t);
+extern void stats_query(stats_t *, int, mstime_t, double *, double *);
+extern int stats_write(stats_t *, mstime_t, const char *);
+
+#endif /* STATS_H */
@@ -0,0 +1,141 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Tests for the rolling-window statistics in stats.c.  Run by "make
+   test".  Randomized press patterns are checked against a brute-force
+   count over the same bucket boundaries. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "stats.h"
+#include "check.h"
+
+#define T0 1637000000000LL /* bucket aligned for every window below */
+
+static void test_single_press()
+{
+  stats_t s;
+  int w[] = {60};
+  double frac, ppm;
+
+  stats_init(&s, w, 1, T0);
+  stats_down(&s, T0 + 10000);
+  stats_up(&s, T0 + 25000);
+
+  /* 15 s down out of 30 s since start */
+  stats_query(&s, 0, T0 + 30000, &frac, &ppm);
+  CHECK(fabs(frac - 0.5) < 1e-9);
+  CHECK(fabs(ppm - 2.0) < 1e-9);
+
+  /* a full window is the current partial bucket and the 59 before
+     it: here 15 s out of just under 60 s */
+  stats_query(&s, 0, T0 + 60999, &frac, &ppm);
+  CHECK(fabs(frac - 15000.0/59999) < 1e-9);
+  CHECK(fabs(ppm - 60000.0/59999) < 1e-9);
+}
+
+static void test_expiry()
+{
+  stats_t s;
+  int w[] = {60};
+  double frac, ppm;
+
+  stats_init(&s, w, 1, T0);
+  stats_down(&s, T0);
+  stats_up(&s, T0 + 5000);
+
+  /* the 1 s buckets holding the press drop out one by one */
+  stats_query(&s, 0, T0 + 62500, &frac, &ppm);
+  CHECK(fabs(frac - 2000.0/59500) < 1e-9);
+  CHECK(ppm == 0);
+
+  /* long after, everything is gone */
+  stats_query(&s, 0, T0 + 1000000, &frac, &ppm);
+  CHECK(frac == 0 && ppm == 0);
+}
+
+static void test_held_down()
+{
+  stats_t s;
+  int w[] = {10, 60};
+  double frac, ppm;
+
+  /* held for longer than either window, credited only now and then */
+  stats_init(&s, w, 2, T0);
+  stats_down(&s, T0 + 1000);
+  stats_credit(&s, T0 + 200000);
+  stats_credit(&s, T0 + 500000);
+
+  stats_query(&s, 0, T0 + 500000, &frac, &ppm);
+  CHECK(fabs(frac - 1.0) < 1e-9);
+  CHECK(ppm == 0);
+  stats_query(&s, 1, T0 + 500000, &frac, &ppm);
+  CHECK(fabs(frac - 1.0) < 1e-9);
+
+  /* credit never goes backwards */
+  stats_credit(&s, T0 + 400000);
+  stats_up(&s, T0 + 500000);
+  stats_query(&s, 1, T0 + 500000, &frac, &ppm);
+  CHECK(fabs(frac - 1.0) < 1e-9);
+}
+
+static void test_random_property()
+/* Random presses with random credit points must give the same totals
+   as adding up each press directly over the buckets still in the
+   window */
+{
+  stats_t s;
+  int w[] = {5, 60, 600};
+  mstime_t t = T0, down, up, c, from;
+  mstime_t pdown[2000], pup[2000];
+  int np = 0, i, k, presses;
+  double frac, ppm, expect, lo, hi;
+
+  srandom(3);
+  stats_init(&s, w, 3, T0);
+  while (np < 2000) {
+    down = t + random() % 5000;
+    up = down + 11 + random() % 8000;
+    stats_down(&s, down);
+    for (c = down + random() % 700; c < up; c += random() % 700) stats_credit(&s, c);
+    stats_up(&s, up);
+    pdown[np] = down;
+    pup[np] = up;
+    np++;
+    t = up + 1000;
+
+    if (np % 97) continue;
+    for (k = 0; k < 3; k++) {
+      stats_query(&s, k, t, &frac, &ppm);
+      from = (t / s.win[k].bucketms - STATSBUCKETS + 1) * s.win[k].bucketms;
+      expect = 0;
+      presses = 0;
+      for (i = 0; i < np; i++) {
+	lo = pdown[i] > from ? pdown[i] : from;
+	hi = pup[i];
+	if (hi > lo) expect += hi - lo;
+	if (pdown[i] >= from) presses++;
+      }
+      CHECK(fabs(frac - expect / (t - from)) < 1e-9);
+      CHECK(fabs(ppm - presses * 60000.0 / (t - from)) < 1e-9);
+    }
+  }
+}
+
+int main()
+{
+  test_single_press();
+  test_expiry();
+  test_held_down();
+  test_random_property();
+
+  return(check_result("stats_test", 0));
+}
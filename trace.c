@@ -0,0 +1,159 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "footlog.h"
+#include "trace.h"
+
+char TraceFileName[BUFLEN] = ""; /* empty means no tracing; set by "-T" */
+long TraceEntries = TRACEDEFAULT; /* change via "-N" */
+
+struct traceent *tracebuf = 0;
+uint64_t tracehead = 0, tracemask = 0;
+
+static int64_t realoffset;
+static volatile sig_atomic_t dumping = 0;
+
+static void write_all(int fd, const void *buf, size_t len)
+/* write() until done or failed; async-signal-safe */
+{
+  const char *p = buf;
+  ssize_t rc;
+
+  while (len > 0) {
+    rc = write(fd, p, len);
+    if (rc < 0 && errno == EINTR) continue;
+    if (rc <= 0) return;
+    p += rc;
+    len -= rc;
+  }
+}
+
+void trace_dump(int sig)
+/* Write the ring to TraceFileName, oldest entry first.  Only uses
+   async-signal-safe calls, so that it can run in a signal handler,
+   even on a crash.  sig is recorded in a final TR_DUMP entry */
+{
+  struct traceheader hdr;
+  uint64_t head, n, first;
+  int fd, saved = errno;
+
+  if (!tracebuf || dumping) return;
+  dumping = 1;
+  trace(TR_DUMP, 0, sig, 0, 0);
+
+  head = tracehead;
+  n = head < tracemask + 1 ? head : tracemask + 1;
+  first = (head - n) & tracemask;
+
+  fd = open(TraceFileName, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd >= 0) {
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACEMAGIC, sizeof(hdr.magic));
+    hdr.entsize = sizeof(struct traceent);
+    hdr.nent = n;
+    hdr.total = head;
+    hdr.realoffset = realoffset;
+    write_all(fd, &hdr, sizeof(hdr));
+
+    /* The ring in two pieces: first..end, then 0..whatever is left */
+    if (first + n <= tracemask + 1)
+      write_all(fd, &tracebuf[first], n * sizeof(struct traceent));
+    else {
+      write_all(fd, &tracebuf[first], (tracemask + 1 - first) * sizeof(struct traceent));
+      write_all(fd, &tracebuf[0], (first + n - tracemask - 1) * sizeof(struct traceent));
+    }
+    close(fd);
+  }
+  dumping = 0;
+  errno = saved;
+}
+
+static void dump_on_signal(int sig)
+/* SIGUSR1: dump and carry on */
+{
+  trace_dump(sig);
+}
+
+static void dump_and_die(int sig)
+/* Crash signals: dump, then die of the same signal as if we had not
+   caught it.  SIGTERM and SIGINT are not among them: logevents()
+   stops on those and exits, and dump_at_exit() writes the ring */
+{
+  trace_dump(sig);
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+static void dump_at_exit()
+{
+  trace_dump(0);
+}
+
+void trace_open(const char *path, long n)
+/* Start tracing into a ring of n entries (rounded up to a power of
+   2), to be dumped into path */
+{
+  static const int fatal[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+  struct sigaction sa;
+  struct timespec mono, real;
+  stack_t ss;
+  long size;
+  unsigned i;
+
+  if (path != TraceFileName) snprintf(TraceFileName, BUFLEN, "%s", path);
+  for (size = 1; size < n; size <<= 1) ;
+
+  /* Allocate and touch the whole ring now, and keep it in memory, so
+     that tracing never takes a page fault */
+  tracebuf = mmap(0, size * sizeof(struct traceent), PROT_READ|PROT_WRITE,
+		  MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
+  if (tracebuf == MAP_FAILED) {
+    perror("trace ring");
+    exit(-1);
+  }
+  mlock(tracebuf, size * sizeof(struct traceent)); /* best effort */
+  tracemask = size - 1;
+  tracehead = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+  clock_gettime(CLOCK_REALTIME, &real);
+  realoffset = ((int64_t) real.tv_sec - mono.tv_sec) * 1000000000
+    + (real.tv_nsec - mono.tv_nsec);
+
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sa.sa_handler = dump_on_signal;
+  sigaction(SIGUSR1, &sa, 0);
+
+  /* The crash handlers need a stack of their own, in case the crash
+     was a stack overflow */
+  ss.ss_size = 1 << 16;
+  ss.ss_sp = malloc(ss.ss_size);
+  ss.ss_flags = 0;
+  if (ss.ss_sp) sigaltstack(&ss, 0);
+  sa.sa_flags = SA_RESETHAND | SA_ONSTACK;
+  sa.sa_handler = dump_and_die;
+  for (i = 0; i < sizeof(fatal)/sizeof(fatal[0]); i++) sigaction(fatal[i], &sa, 0);
+  atexit(dump_at_exit);
+
+  if (DebugFlag) fprintf(stderr, "Tracing %ld entries into %s\n", size, TraceFileName);
+}
@@ -0,0 +1,87 @@
+/*
+   Copyright (C) 2021 Carnegie Mellon University
+
+   This code is distributed "AS IS" without warranty of any kind under
+   the terms of the GNU General Public Licence Version 2.
+
+*/
+
+/* Binary trace ring ("footlog -T <file>").  logevents() records what
+   it does in fixed-size entries in a preallocated ring in memory,
+   rather than printing it: each entry is a clock read and a few
+   stores, so tracing barely moves the timing being traced.  The ring
+   keeps the most recent entries and is written to the trace file on
+   SIGUSR1, at exit (which is how SIGTERM/SIGINT end logevents()),
+   and on a crash; "footrace
+   <file>" decodes it.  The file format is shared with footrace, so
+   this header does not depend on footlog.h. */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define TRACEMAGIC "FOOTTRC1"
+#define TRACEDEFAULT 65536 /* entries in the ring; a power of 2 */
+
+/* Entry kinds, and what a, b and c hold */
+#define TR_WAKEUP 1  /* select() returned: a = rc, b = timeout in ms or -1 */
+#define TR_READ 2    /* read() from device dev: a = bytes */
+#define TR_EVENT 3   /* input event from dev: a = type << 16 | code,
+			b = value, c = event timestamp in us */
+#define TR_GAP 4     /* the detector's gap decision, on a KEY_1 during a
+			sequence or on whatever event came a whole gap
+			after the last one: a = gap in ms, b = 1 if it
+			ended the sequence */
+#define TR_START 5   /* sequence started: b = FirstOne in ms */
+#define TR_END 6     /* sequence ended: a = seqlen, b = LastOne in ms,
+			c = REC_UP or REC_RUNT */
+#define TR_MARKERS 7 /* markers received: a = how many */
+#define TR_SLEEP 8   /* about to nanosleep(): a = ms */
+#define TR_DUMP 9    /* ring written out: a = signal number, 0 at exit */
+
+struct traceent {
+  int64_t ns;     /* CLOCK_MONOTONIC */
+  uint16_t kind;  /* TR_* */
+  uint16_t dev;   /* device index, where relevant */
+  int32_t a;
+  int64_t b;
+  int64_t c;
+};
+
+struct traceheader {
+  char magic[8];
+  uint32_t entsize;   /* sizeof(struct traceent) */
+  uint32_t nent;      /* entries that follow, oldest first */
+  uint64_t total;     /* entries ever recorded; more than nent if
+			 the ring wrapped */
+  int64_t realoffset; /* add to ns for CLOCK_REALTIME */
+};
+
+/* The ring; tracebuf is null when tracing is off */
+extern struct traceent *tracebuf;
+extern uint64_t tracehead, tracemask;
+
+extern void trace_open(const char *, long);
+extern void trace_dump(int);
+
+static inline void trace(int kind, int dev, int32_t a, int64_t b, int64_t c)
+/* Record one entry; nothing if tracing is off */
+{
+  struct traceent *e;
+  struct timespec ts;
+
+  if (!tracebuf) return;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  e = &tracebuf[tracehead & tracemask];
+  e->ns = (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+  e->kind = kind;
+  e->dev = dev;
+  e->a = a;
+  e->b = b;
+  e->c = c;
+  tracehead++;
+}
+
+#endif /* TRACE_H */
@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include "footlog.h"
+#include "pedal.h"
 
 
 int usbstuff_discover() 
@@ -32,43 +33,19 @@ int usbstuff_discover()
    System-level errors cause exit with error message
 */
 {
-  static char oneline[BUFLEN];
-  int rc;
-  FILE *shellout;
-  char *s, *where;
-
-  exec_shellcmd("lsusb"); /* successful if control returns */
-
-  shellout = fopen(tmpfilename, "r");
-  if (!shellout) {
-    perror(tmpfilename);
-    exit(-1);
-  }
-
-  where = 0; /* not found yet */
-  while (!feof(shellout)) {
-    s = fgets(oneline, sizeof(oneline)-1, shellout);
-    if (!s) {
-      if (feof(shellout)) break; /* hit EOF */
-      else
-	{/* something abnormal */
-	  perror(tmpfilename);
-	  exit(-1);
-	}
-    }
-    where = strstr(oneline, "QinHeng Electronics");
-    if (where) break; /* found it! */
-  }
-  if (!where) return (-1); /* device not found */
+  pedalusb_t u;
 
-  /* Can't use %s for fpdescription because of possible whitespace */
-  rc = sscanf(oneline, "Bus %3s Device %3s: ID %4s:%4s%[^\n]",
-	      fpbus, fpdevice, fpid1, fpid2, fpdescription);
-  if (rc != 5) {
-    fprintf(stderr, "sscanf() returns %d rather than 5\n", rc);
+  if (pedal_discover(PEDALUSBMATCH, &u) < 0) {
+    if (errno == ENODEV) return (-1); /* device not found */
+    perror("lsusb");
     exit(-1);
   }
 
+  snprintf(fpbus, BUFLEN, "%s", u.bus);
+  snprintf(fpdevice, BUFLEN, "%s", u.device);
+  snprintf(fpid1, BUFLEN, "%s", u.id1);
+  snprintf(fpid2, BUFLEN, "%s", u.id2);
+  snprintf(fpdescription, BUFLEN, "%s", u.description);
   return(0); /* success */
 }
 